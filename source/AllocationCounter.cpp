@@ -0,0 +1,75 @@
+#include "AllocationCounter.h"
+
+//Standard includes
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#ifdef _DEBUG
+namespace
+{
+	std::atomic<uint64_t> g_AllocationCount{};
+
+	void* Allocate(size_t size)
+	{
+		g_AllocationCount.fetch_add(1, std::memory_order_relaxed);
+		if (void* pMemory = std::malloc(size ? size : 1))
+			return pMemory;
+
+		throw std::bad_alloc{};
+	}
+
+	//The pointer malloc returned is stored right in front of the aligned block
+	void* AllocateAligned(size_t size, std::align_val_t alignment)
+	{
+		const size_t alignmentSize{ static_cast<size_t>(alignment) };
+		void* pMemory{ Allocate(size + alignmentSize + sizeof(void*)) };
+
+		const uintptr_t alignedAddress{ (reinterpret_cast<uintptr_t>(pMemory) + sizeof(void*) + alignmentSize - 1) & ~(alignmentSize - 1) };
+		reinterpret_cast<void**>(alignedAddress)[-1] = pMemory;
+		return reinterpret_cast<void*>(alignedAddress);
+	}
+
+	void FreeAligned(void* pMemory)
+	{
+		if (pMemory)
+			std::free(static_cast<void**>(pMemory)[-1]);
+	}
+}
+
+//Global replacements, the array and nothrow versions forward to these by default
+void* operator new(size_t size) { return Allocate(size); }
+void* operator new[](size_t size) { return Allocate(size); }
+void operator delete(void* pMemory) noexcept { std::free(pMemory); }
+void operator delete[](void* pMemory) noexcept { std::free(pMemory); }
+void operator delete(void* pMemory, size_t) noexcept { std::free(pMemory); }
+void operator delete[](void* pMemory, size_t) noexcept { std::free(pMemory); }
+
+void* operator new(size_t size, std::align_val_t alignment) { return AllocateAligned(size, alignment); }
+void* operator new[](size_t size, std::align_val_t alignment) { return AllocateAligned(size, alignment); }
+void operator delete(void* pMemory, std::align_val_t) noexcept { FreeAligned(pMemory); }
+void operator delete[](void* pMemory, std::align_val_t) noexcept { FreeAligned(pMemory); }
+void operator delete(void* pMemory, size_t, std::align_val_t) noexcept { FreeAligned(pMemory); }
+void operator delete[](void* pMemory, size_t, std::align_val_t) noexcept { FreeAligned(pMemory); }
+#endif
+
+namespace dae
+{
+	bool AllocationCounter::IsEnabled()
+	{
+#ifdef _DEBUG
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	uint64_t AllocationCounter::GetAllocationCount()
+	{
+#ifdef _DEBUG
+		return g_AllocationCount.load(std::memory_order_relaxed);
+#else
+		return 0;
+#endif
+	}
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+//Standard includes
+#include <cstdint>
+
+namespace dae
+{
+	//Counts every heap allocation that goes through the global operator new.
+	//The counting operators are only compiled into debug builds, release builds always report 0.
+	namespace AllocationCounter
+	{
+		bool IsEnabled();
+		uint64_t GetAllocationCount();
+	}
+}
@@ -0,0 +1,221 @@
+#include "BVH.h"
+
+#include <cassert>
+
+namespace dae
+{
+	namespace
+	{
+		constexpr int BinCount{ 16 };
+		//Cost of visiting a node relative to intersecting one block of primitives
+		constexpr float TraversalCost{ 1.f };
+
+		struct Bin
+		{
+			AABB bounds{};
+			int primitiveCount{};
+		};
+	}
+
+	void BVH::Build(const std::vector<AABB>& primitiveBounds, int maxLeafSize, int leafBlockSize)
+	{
+		const int primitiveCount{ static_cast<int>(primitiveBounds.size()) };
+		m_LeafBlockSize = std::max(leafBlockSize, 1);
+
+		m_Nodes.clear();
+		m_PrimitiveIndices.resize(primitiveCount);
+		m_Centroids.resize(primitiveCount);
+		m_BuildCost = 0.f;
+		m_Cost = 0.f;
+		if (primitiveCount == 0)
+			return;
+
+		for (int idx{}; idx < primitiveCount; ++idx)
+		{
+			m_PrimitiveIndices[idx] = idx;
+			m_Centroids[idx] = primitiveBounds[idx].GetCenter();
+		}
+
+		//A binary tree with n leaves never needs more than 2n - 1 nodes
+		m_Nodes.reserve(2 * primitiveCount - 1);
+		m_Nodes.push_back({ {}, 0, primitiveCount });
+		UpdateNodeBounds(0, primitiveBounds);
+
+		Subdivide(0, primitiveBounds, maxLeafSize, 1);
+
+		m_BuildCost = CalculateCost();
+		m_Cost = m_BuildCost;
+	}
+
+	void BVH::Refit(const std::vector<AABB>& primitiveBounds)
+	{
+		assert(static_cast<int>(primitiveBounds.size()) == GetPrimitiveCount() && "Refit needs the primitives of the last build");
+
+		//Children are always stored after their parent, so walking backwards visits them first
+		for (int nodeIdx{ static_cast<int>(m_Nodes.size()) - 1 }; nodeIdx >= 0; --nodeIdx)
+		{
+			BVHNode& node{ m_Nodes[nodeIdx] };
+			if (node.IsLeaf())
+			{
+				UpdateNodeBounds(nodeIdx, primitiveBounds);
+				continue;
+			}
+
+			node.bounds = m_Nodes[node.leftFirst].bounds;
+			node.bounds.Grow(m_Nodes[node.leftFirst + 1].bounds);
+		}
+
+		m_Cost = CalculateCost();
+	}
+
+	void BVH::Subdivide(int nodeIdx, const std::vector<AABB>& primitiveBounds, int maxLeafSize, int depth)
+	{
+		const BVHNode node{ m_Nodes[nodeIdx] };
+		if (node.primitiveCount <= 1 || depth >= MaxDepth)
+			return;
+
+		int axis{};
+		float splitPosition{};
+		const float splitCost{ FindBestSplit(node, primitiveBounds, axis, splitPosition) };
+
+		//Keep the leaf when splitting doesn't pay off, unless it is too big to be a leaf.
+		//Only block leaves charge the node visit a split adds, it is what lets them fill up to whole SIMD blocks.
+		//Trees over single primitives (top level, lights) keep comparing the bare split cost.
+		const float leafCost{ GetBlockCount(node.primitiveCount) * node.bounds.GetSurfaceArea() };
+		const float splitTraversalCost{ m_LeafBlockSize > 1 ? TraversalCost * node.bounds.GetSurfaceArea() : 0.f };
+		if (splitCost == FLT_MAX || (splitCost + splitTraversalCost >= leafCost && node.primitiveCount <= maxLeafSize))
+			return;
+
+		//Partition the primitive indices around the split plane
+		int first{ node.leftFirst };
+		int last{ node.leftFirst + node.primitiveCount - 1 };
+		while (first <= last)
+		{
+			if (m_Centroids[m_PrimitiveIndices[first]][axis] < splitPosition)
+				++first;
+			else
+				std::swap(m_PrimitiveIndices[first], m_PrimitiveIndices[last--]);
+		}
+
+		const int leftCount{ first - node.leftFirst };
+		if (leftCount == 0 || leftCount == node.primitiveCount)
+			return;
+
+		const int leftIdx{ static_cast<int>(m_Nodes.size()) };
+		m_Nodes.push_back({ {}, node.leftFirst, leftCount });
+		m_Nodes.push_back({ {}, first, node.primitiveCount - leftCount });
+		UpdateNodeBounds(leftIdx, primitiveBounds);
+		UpdateNodeBounds(leftIdx + 1, primitiveBounds);
+
+		m_Nodes[nodeIdx].leftFirst = leftIdx;
+		m_Nodes[nodeIdx].primitiveCount = 0;
+
+		Subdivide(leftIdx, primitiveBounds, maxLeafSize, depth + 1);
+		Subdivide(leftIdx + 1, primitiveBounds, maxLeafSize, depth + 1);
+	}
+
+	float BVH::FindBestSplit(const BVHNode& node, const std::vector<AABB>& primitiveBounds, int& axis, float& splitPosition) const
+	{
+		//Bin over the centroid bounds, the primitive bounds can be much wider than the spread of the centroids
+		AABB centroidBounds{};
+		for (int idx{ node.leftFirst }; idx < node.leftFirst + node.primitiveCount; ++idx)
+		{
+			centroidBounds.Grow(m_Centroids[m_PrimitiveIndices[idx]]);
+		}
+
+		float bestCost{ FLT_MAX };
+		for (int currentAxis{}; currentAxis < 3; ++currentAxis)
+		{
+			const float boundsMin{ centroidBounds.min[currentAxis] };
+			const float boundsMax{ centroidBounds.max[currentAxis] };
+			if (boundsMin == boundsMax)
+				continue;
+
+			Bin bins[BinCount]{};
+			const float scale{ BinCount / (boundsMax - boundsMin) };
+			for (int idx{ node.leftFirst }; idx < node.leftFirst + node.primitiveCount; ++idx)
+			{
+				const int primitiveIdx{ m_PrimitiveIndices[idx] };
+				const int binIdx{ std::min(BinCount - 1, static_cast<int>((m_Centroids[primitiveIdx][currentAxis] - boundsMin) * scale)) };
+				bins[binIdx].bounds.Grow(primitiveBounds[primitiveIdx]);
+				++bins[binIdx].primitiveCount;
+			}
+
+			//Sweep from both sides to get the cost of every plane between two bins
+			float leftArea[BinCount - 1]{};
+			float rightArea[BinCount - 1]{};
+			int leftCount[BinCount - 1]{};
+			int rightCount[BinCount - 1]{};
+
+			AABB leftBox{};
+			AABB rightBox{};
+			int leftSum{};
+			int rightSum{};
+			for (int idx{}; idx < BinCount - 1; ++idx)
+			{
+				leftSum += bins[idx].primitiveCount;
+				leftCount[idx] = leftSum;
+				leftBox.Grow(bins[idx].bounds);
+				leftArea[idx] = leftSum > 0 ? leftBox.GetSurfaceArea() : 0.f;
+
+				rightSum += bins[BinCount - 1 - idx].primitiveCount;
+				rightCount[BinCount - 2 - idx] = rightSum;
+				rightBox.Grow(bins[BinCount - 1 - idx].bounds);
+				rightArea[BinCount - 2 - idx] = rightSum > 0 ? rightBox.GetSurfaceArea() : 0.f;
+			}
+
+			for (int idx{}; idx < BinCount - 1; ++idx)
+			{
+				if (leftCount[idx] == 0 || rightCount[idx] == 0)
+					continue;
+
+				const float cost{ GetBlockCount(leftCount[idx]) * leftArea[idx] + GetBlockCount(rightCount[idx]) * rightArea[idx] };
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					axis = currentAxis;
+					splitPosition = boundsMin + (idx + 1) / scale;
+				}
+			}
+		}
+
+		return bestCost;
+	}
+
+	void BVH::Assign(std::vector<BVHNode> nodes, std::vector<int> primitiveIndices, int leafBlockSize)
+	{
+		m_Nodes = std::move(nodes);
+		m_PrimitiveIndices = std::move(primitiveIndices);
+		m_LeafBlockSize = std::max(leafBlockSize, 1);
+
+		m_BuildCost = CalculateCost();
+		m_Cost = m_BuildCost;
+	}
+
+	float BVH::CalculateCost() const
+	{
+		if (m_Nodes.empty())
+			return 0.f;
+
+		const float rootArea{ m_Nodes[0].bounds.GetSurfaceArea() };
+		if (rootArea <= 0.f)
+			return 0.f;
+
+		float cost{};
+		for (const BVHNode& node : m_Nodes)
+		{
+			cost += node.bounds.GetSurfaceArea() * (node.IsLeaf() ? static_cast<float>(GetBlockCount(node.primitiveCount)) : TraversalCost);
+		}
+		return cost / rootArea;
+	}
+
+	void BVH::UpdateNodeBounds(int nodeIdx, const std::vector<AABB>& primitiveBounds)
+	{
+		BVHNode& node{ m_Nodes[nodeIdx] };
+		node.bounds = {};
+		for (int idx{ node.leftFirst }; idx < node.leftFirst + node.primitiveCount; ++idx)
+		{
+			node.bounds.Grow(primitiveBounds[m_PrimitiveIndices[idx]]);
+		}
+	}
+}
@@ -0,0 +1,357 @@
+#pragma once
+#include <algorithm>
+#include <cfloat>
+#include <vector>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "Math.h"
+#include "RayPacket.h"
+
+namespace dae
+{
+	struct AABB
+	{
+		Vector3 min{ FLT_MAX, FLT_MAX, FLT_MAX };
+		Vector3 max{ -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+		void Grow(const Vector3& point)
+		{
+			min = { std::min(min.x, point.x), std::min(min.y, point.y), std::min(min.z, point.z) };
+			max = { std::max(max.x, point.x), std::max(max.y, point.y), std::max(max.z, point.z) };
+		}
+
+		//Componentwise, so growing by an empty (inverted) box leaves this one unchanged
+		void Grow(const AABB& other)
+		{
+			min = { std::min(min.x, other.min.x), std::min(min.y, other.min.y), std::min(min.z, other.min.z) };
+			max = { std::max(max.x, other.max.x), std::max(max.y, other.max.y), std::max(max.z, other.max.z) };
+		}
+
+		bool Contains(const Vector3& point) const
+		{
+			return point.x >= min.x && point.y >= min.y && point.z >= min.z && point.x <= max.x && point.y <= max.y && point.z <= max.z;
+		}
+
+		Vector3 GetCenter() const
+		{
+			return (min + max) * 0.5f;
+		}
+
+		float GetSurfaceArea() const
+		{
+			const Vector3 extent{ max - min };
+			return 2.f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+		}
+	};
+
+	//32 bytes, two nodes share a cache line
+	struct BVHNode
+	{
+		AABB bounds{};
+		int leftFirst{}; //leaf: first primitive index, interior: index of the left child (right child = leftFirst + 1)
+		int primitiveCount{};
+
+		bool IsLeaf() const { return primitiveCount > 0; }
+	};
+
+	/**
+	 * \brief Slab test between a ray and a bounding box
+	 * \return distance to the entry point, FLT_MAX if the box is missed within [tMin, tMax]
+	 */
+	inline float IntersectAABB(const AABB& box, const Vector3& origin, const Vector3& invDirection, float tMin, float tMax)
+	{
+		const float tx1{ (box.min.x - origin.x) * invDirection.x };
+		const float tx2{ (box.max.x - origin.x) * invDirection.x };
+		float tNear{ std::min(tx1, tx2) };
+		float tFar{ std::max(tx1, tx2) };
+
+		const float ty1{ (box.min.y - origin.y) * invDirection.y };
+		const float ty2{ (box.max.y - origin.y) * invDirection.y };
+		tNear = std::max(tNear, std::min(ty1, ty2));
+		tFar = std::min(tFar, std::max(ty1, ty2));
+
+		const float tz1{ (box.min.z - origin.z) * invDirection.z };
+		const float tz2{ (box.max.z - origin.z) * invDirection.z };
+		tNear = std::max(tNear, std::min(tz1, tz2));
+		tFar = std::min(tFar, std::max(tz1, tz2));
+
+		if (tFar < tNear || tFar < tMin || tNear > tMax)
+			return FLT_MAX;
+
+		return std::max(tNear, tMin);
+	}
+
+	/**
+	 * \brief Slab test between the active rays of a packet and a bounding box
+	 * \param tEntry smallest entry distance over the rays that hit the box, FLT_MAX if none
+	 * \return mask of the rays that hit the box within [min, max]
+	 */
+	inline uint32_t IntersectAABB(const AABB& box, const RayPacket& packet, uint32_t activeMask, float& tEntry)
+	{
+		uint32_t hitMask{};
+		tEntry = FLT_MAX;
+
+#if defined(_M_X64) || defined(__SSE2__)
+		const __m128 boxMinX{ _mm_set1_ps(box.min.x) };
+		const __m128 boxMinY{ _mm_set1_ps(box.min.y) };
+		const __m128 boxMinZ{ _mm_set1_ps(box.min.z) };
+		const __m128 boxMaxX{ _mm_set1_ps(box.max.x) };
+		const __m128 boxMaxY{ _mm_set1_ps(box.max.y) };
+		const __m128 boxMaxZ{ _mm_set1_ps(box.max.z) };
+		const __m128 rayMin{ _mm_set1_ps(packet.min) };
+
+		for (int row{}; row < RayPacket::Size; row += RayPacket::Width)
+		{
+			const uint32_t rowActive{ (activeMask >> row) & 0xF };
+			if (rowActive == 0)
+				continue;
+
+			const __m128 originX{ _mm_load_ps(&packet.originX[row]) };
+			const __m128 originY{ _mm_load_ps(&packet.originY[row]) };
+			const __m128 originZ{ _mm_load_ps(&packet.originZ[row]) };
+			const __m128 invDirectionX{ _mm_load_ps(&packet.invDirectionX[row]) };
+			const __m128 invDirectionY{ _mm_load_ps(&packet.invDirectionY[row]) };
+			const __m128 invDirectionZ{ _mm_load_ps(&packet.invDirectionZ[row]) };
+
+			const __m128 tx1{ _mm_mul_ps(_mm_sub_ps(boxMinX, originX), invDirectionX) };
+			const __m128 tx2{ _mm_mul_ps(_mm_sub_ps(boxMaxX, originX), invDirectionX) };
+			const __m128 ty1{ _mm_mul_ps(_mm_sub_ps(boxMinY, originY), invDirectionY) };
+			const __m128 ty2{ _mm_mul_ps(_mm_sub_ps(boxMaxY, originY), invDirectionY) };
+			const __m128 tz1{ _mm_mul_ps(_mm_sub_ps(boxMinZ, originZ), invDirectionZ) };
+			const __m128 tz2{ _mm_mul_ps(_mm_sub_ps(boxMaxZ, originZ), invDirectionZ) };
+
+			const __m128 tNear{ _mm_max_ps(_mm_max_ps(_mm_min_ps(tx1, tx2), _mm_min_ps(ty1, ty2)), _mm_min_ps(tz1, tz2)) };
+			const __m128 tFar{ _mm_min_ps(_mm_min_ps(_mm_max_ps(tx1, tx2), _mm_max_ps(ty1, ty2)), _mm_max_ps(tz1, tz2)) };
+
+			__m128 mask{ _mm_cmple_ps(tNear, tFar) };
+			mask = _mm_and_ps(mask, _mm_cmpge_ps(tFar, rayMin));
+			mask = _mm_and_ps(mask, _mm_cmple_ps(tNear, _mm_load_ps(&packet.max[row])));
+
+			const uint32_t rowHit{ static_cast<uint32_t>(_mm_movemask_ps(mask)) & rowActive };
+			if (rowHit == 0)
+				continue;
+
+			hitMask |= rowHit << row;
+
+			alignas(16) float entries[RayPacket::Width];
+			_mm_store_ps(entries, _mm_max_ps(tNear, rayMin));
+			for (int lane{}; lane < RayPacket::Width; ++lane)
+			{
+				if (rowHit & (1u << lane))
+					tEntry = std::min(tEntry, entries[lane]);
+			}
+		}
+#else
+		for (int lane{}; lane < RayPacket::Size; ++lane)
+		{
+			if ((activeMask & (1u << lane)) == 0)
+				continue;
+
+			const float t{ IntersectAABB(box, packet.GetOrigin(lane),
+				{ packet.invDirectionX[lane], packet.invDirectionY[lane], packet.invDirectionZ[lane] }, packet.min, packet.max[lane]) };
+			if (t == FLT_MAX)
+				continue;
+
+			hitMask |= 1u << lane;
+			tEntry = std::min(tEntry, t);
+		}
+#endif
+
+		return hitMask;
+	}
+
+	//Bounding volume hierarchy over a set of primitive bounds, stored as a flat node array (root = node 0)
+	class BVH final
+	{
+	public:
+		/**
+		 * \brief Builds the hierarchy top-down using binned SAH splits
+		 * \param primitiveBounds bounds of every primitive, the index in this vector is the primitive index
+		 * \param maxLeafSize leaves are only forced to split when they hold more primitives than this
+		 * \param leafBlockSize primitives that are intersected at once, the SAH charges every started block as a full one
+		 */
+		void Build(const std::vector<AABB>& primitiveBounds, int maxLeafSize = 4, int leafBlockSize = 1);
+
+		/**
+		 * \brief Updates the node bounds bottom-up for moved primitives, the tree topology is kept
+		 * \param primitiveBounds new bounds, must hold the same primitives as the last build
+		 */
+		void Refit(const std::vector<AABB>& primitiveBounds);
+
+		/**
+		 * \brief Takes over a hierarchy that was built before, e.g. one read back from a cache
+		 * \param leafBlockSize block size the hierarchy was built with
+		 */
+		void Assign(std::vector<BVHNode> nodes, std::vector<int> primitiveIndices, int leafBlockSize);
+
+		//Refitted trees get looser as primitives move away from their original neighbours
+		bool NeedsRebuild() const { return m_Cost > m_BuildCost * RebuildThreshold; }
+
+		bool IsEmpty() const { return m_Nodes.empty(); }
+		int GetPrimitiveCount() const { return static_cast<int>(m_PrimitiveIndices.size()); }
+		float GetCost() const { return m_Cost; }
+		int GetLeafBlockSize() const { return m_LeafBlockSize; }
+		const AABB& GetBounds() const { return m_Nodes[0].bounds; }
+		const std::vector<BVHNode>& GetNodes() const { return m_Nodes; }
+		const std::vector<int>& GetPrimitiveIndices() const { return m_PrimitiveIndices; }
+
+		/**
+		 * \brief Walks the hierarchy front to back and calls intersectLeaf(leaf, tMax) for every leaf the ray enters
+		 * \param tMax current search distance, the leaf callback shrinks it to prune farther nodes
+		 * \param intersectLeaf returns true to stop the traversal (any-hit queries)
+		 * \return true if the traversal was stopped by the leaf callback
+		 */
+		template<typename LeafFunc>
+		bool Traverse(const Vector3& origin, const Vector3& direction, float tMin, float& tMax, const LeafFunc& intersectLeaf) const
+		{
+			if (m_Nodes.empty())
+				return false;
+
+			const Vector3 invDirection{ 1.f / direction.x, 1.f / direction.y, 1.f / direction.z };
+			if (IntersectAABB(m_Nodes[0].bounds, origin, invDirection, tMin, tMax) == FLT_MAX)
+				return false;
+
+			struct StackEntry
+			{
+				int nodeIdx;
+				float tEntry;
+			};
+			StackEntry stack[MaxDepth];
+			int stackSize{};
+
+			int nodeIdx{};
+			while (true)
+			{
+				const BVHNode& node{ m_Nodes[nodeIdx] };
+				if (node.IsLeaf())
+				{
+					if (intersectLeaf(node, tMax))
+						return true;
+				}
+				else
+				{
+					int nearIdx{ node.leftFirst };
+					int farIdx{ node.leftFirst + 1 };
+					float tNear{ IntersectAABB(m_Nodes[nearIdx].bounds, origin, invDirection, tMin, tMax) };
+					float tFar{ IntersectAABB(m_Nodes[farIdx].bounds, origin, invDirection, tMin, tMax) };
+					if (tFar < tNear)
+					{
+						std::swap(nearIdx, farIdx);
+						std::swap(tNear, tFar);
+					}
+
+					if (tNear != FLT_MAX)
+					{
+						if (tFar != FLT_MAX)
+							stack[stackSize++] = { farIdx, tFar };
+
+						nodeIdx = nearIdx;
+						continue;
+					}
+				}
+
+				//Pop the next node that is still in front of the closest hit so far
+				do
+				{
+					if (stackSize == 0)
+						return false;
+					--stackSize;
+				} while (stack[stackSize].tEntry > tMax);
+				nodeIdx = stack[stackSize].nodeIdx;
+			}
+		}
+
+		/**
+		 * \brief Walks the hierarchy once for a whole packet, a node is entered when any of the active rays hits it
+		 * \param activeMask rays of the packet that take part
+		 * \param intersectLeaf called as intersectLeaf(leaf, laneMask) with the rays that reached the leaf,
+		 * it shrinks packet.max for the rays that found a closer hit
+		 */
+		template<typename LeafFunc>
+		void TraversePacket(RayPacket& packet, uint32_t activeMask, const LeafFunc& intersectLeaf) const
+		{
+			if (m_Nodes.empty())
+				return;
+
+			float tEntry{};
+			uint32_t mask{ IntersectAABB(m_Nodes[0].bounds, packet, activeMask, tEntry) };
+			if (mask == 0)
+				return;
+
+			struct StackEntry
+			{
+				int nodeIdx;
+				uint32_t mask;
+			};
+			StackEntry stack[MaxDepth];
+			int stackSize{};
+
+			int nodeIdx{};
+			while (true)
+			{
+				const BVHNode& node{ m_Nodes[nodeIdx] };
+				if (node.IsLeaf())
+				{
+					intersectLeaf(node, mask);
+				}
+				else
+				{
+					int nearIdx{ node.leftFirst };
+					int farIdx{ node.leftFirst + 1 };
+					float tNear{};
+					float tFar{};
+					uint32_t nearMask{ IntersectAABB(m_Nodes[nearIdx].bounds, packet, mask, tNear) };
+					uint32_t farMask{ IntersectAABB(m_Nodes[farIdx].bounds, packet, mask, tFar) };
+					if (tFar < tNear)
+					{
+						std::swap(nearIdx, farIdx);
+						std::swap(nearMask, farMask);
+					}
+
+					if (nearMask != 0)
+					{
+						if (farMask != 0)
+							stack[stackSize++] = { farIdx, farMask };
+
+						nodeIdx = nearIdx;
+						mask = nearMask;
+						continue;
+					}
+				}
+
+				//Pop the next node and drop the rays that found a closer hit in the meantime
+				do
+				{
+					if (stackSize == 0)
+						return;
+					--stackSize;
+					mask = IntersectAABB(m_Nodes[stack[stackSize].nodeIdx].bounds, packet, stack[stackSize].mask, tEntry);
+				} while (mask == 0);
+				nodeIdx = stack[stackSize].nodeIdx;
+			}
+		}
+
+		static constexpr int MaxDepth{ 64 };
+		static constexpr float RebuildThreshold{ 1.5f };
+
+	private:
+		std::vector<BVHNode> m_Nodes{};
+		std::vector<int> m_PrimitiveIndices{};
+		std::vector<Vector3> m_Centroids{};
+
+		//SAH cost relative to the root area, right after the last build and after the last refit
+		float m_BuildCost{};
+		float m_Cost{};
+		int m_LeafBlockSize{ 1 };
+
+		int GetBlockCount(int primitiveCount) const { return (primitiveCount + m_LeafBlockSize - 1) / m_LeafBlockSize; }
+
+		void Subdivide(int nodeIdx, const std::vector<AABB>& primitiveBounds, int maxLeafSize, int depth);
+		float FindBestSplit(const BVHNode& node, const std::vector<AABB>& primitiveBounds, int& axis, float& splitPosition) const;
+		void UpdateNodeBounds(int nodeIdx, const std::vector<AABB>& primitiveBounds);
+		float CalculateCost() const;
+	};
+}
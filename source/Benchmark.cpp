@@ -0,0 +1,196 @@
+#include "Benchmark.h"
+
+//External includes
+#include "SDL.h"
+
+//Standard includes
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+//Project includes
+#include "Timer.h"
+#include "Renderer.h"
+#include "Scene.h"
+
+namespace dae
+{
+	Benchmark::Benchmark(const BenchmarkSettings& settings) :
+		m_Settings(settings)
+	{
+		//Everything that was not specified falls back to the full suite
+		if (m_Settings.sceneNames.empty())
+			m_Settings.sceneNames = GetSceneNames();
+
+		if (m_Settings.resolutions.empty())
+			m_Settings.resolutions = { { 320, 240 }, { 640, 480 }, { 1280, 720 } };
+
+		if (m_Settings.threadCounts.empty())
+		{
+			const int hardwareThreads{ std::max(static_cast<int>(std::thread::hardware_concurrency()), 1) };
+			m_Settings.threadCounts = { 1, std::max(hardwareThreads / 2, 1), hardwareThreads };
+
+			std::sort(m_Settings.threadCounts.begin(), m_Settings.threadCounts.end());
+			m_Settings.threadCounts.erase(std::unique(m_Settings.threadCounts.begin(), m_Settings.threadCounts.end()), m_Settings.threadCounts.end());
+		}
+	}
+
+	bool Benchmark::Run()
+	{
+		m_Results.clear();
+
+		for (const std::string& sceneName : m_Settings.sceneNames)
+		{
+			for (const BenchmarkResolution& resolution : m_Settings.resolutions)
+			{
+				for (const int threadCount : m_Settings.threadCounts)
+				{
+					if (!RunConfiguration(sceneName, resolution, threadCount))
+						return false;
+				}
+			}
+		}
+
+		const bool isCsv{ m_Settings.outputPath.size() >= 4 && m_Settings.outputPath.compare(m_Settings.outputPath.size() - 4, 4, ".csv") == 0 };
+		if (!(isCsv ? WriteCsv() : WriteJson()))
+		{
+			std::cout << "Could not write benchmark results to " << m_Settings.outputPath << std::endl;
+			return false;
+		}
+
+		std::cout << "Benchmark results written to " << m_Settings.outputPath << std::endl;
+		return true;
+	}
+
+	bool Benchmark::RunConfiguration(const std::string& sceneName, const BenchmarkResolution& resolution, int threadCount)
+	{
+		Scene* pScene{ CreateScene(sceneName) };
+		if (!pScene)
+		{
+			std::cout << "Unknown scene: " << sceneName << std::endl;
+			return false;
+		}
+		pScene->Initialize();
+
+		const auto pTimer = new Timer();
+		const auto pRenderer = new Renderer(resolution.width, resolution.height);
+		if (!pRenderer->HasBuffer())
+		{
+			std::cout << "Could not create a " << resolution.width << "x" << resolution.height << " surface: " << SDL_GetError() << std::endl;
+			delete pRenderer;
+			delete pTimer;
+			delete pScene;
+			return false;
+		}
+		pRenderer->SetThreadCount(threadCount);
+
+		pTimer->SetFixedTimeStep(1.f / 30.f);
+		pTimer->Start();
+
+		BenchmarkResult result{};
+		result.sceneName = sceneName;
+		result.resolution = resolution;
+		result.threadCount = pRenderer->GetThreadCount();
+		result.frameCount = m_Settings.frameCount;
+
+		std::vector<double> frameTimes{};
+		frameTimes.reserve(m_Settings.frameCount);
+
+		double totalMilliseconds{};
+		for (int frameIdx{}; frameIdx < m_Settings.warmupFrames + m_Settings.frameCount; ++frameIdx)
+		{
+			pScene->Update(pTimer);
+
+			const auto startTime{ std::chrono::steady_clock::now() };
+			pRenderer->Render(pScene);
+			const double frameMilliseconds{ std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count() };
+
+			pTimer->Update();
+
+			//Warm up frames fill the caches and build the acceleration structures, they are not measured
+			if (frameIdx < m_Settings.warmupFrames)
+				continue;
+
+			const RayStatistics statistics{ pRenderer->GetRayStatistics() };
+			result.primaryRays += statistics.primaryRays;
+			result.shadowRays += statistics.shadowRays;
+
+			frameTimes.push_back(frameMilliseconds);
+			totalMilliseconds += frameMilliseconds;
+		}
+		pTimer->Stop();
+
+		std::sort(frameTimes.begin(), frameTimes.end());
+		result.medianMilliseconds = GetPercentile(frameTimes, 0.5f);
+		result.p95Milliseconds = GetPercentile(frameTimes, 0.95f);
+		result.p99Milliseconds = GetPercentile(frameTimes, 0.99f);
+		result.raysPerSecond = totalMilliseconds > 0.0 ? (result.primaryRays + result.shadowRays) / (totalMilliseconds / 1000.0) : 0.0;
+
+		std::cout << sceneName << " " << resolution.width << "x" << resolution.height << " " << result.threadCount << " threads: median "
+			<< result.medianMilliseconds << " ms, p95 " << result.p95Milliseconds << " ms, p99 " << result.p99Milliseconds << " ms, "
+			<< result.raysPerSecond / 1e6 << " Mrays/s" << std::endl;
+
+		m_Results.push_back(result);
+
+		delete pRenderer;
+		delete pTimer;
+		delete pScene;
+		return true;
+	}
+
+	bool Benchmark::WriteJson() const
+	{
+		std::ofstream file{ m_Settings.outputPath };
+		if (!file)
+			return false;
+
+		file << "{\n\t\"warmupFrames\": " << m_Settings.warmupFrames << ",\n\t\"results\": [\n";
+		for (size_t resultIdx{}; resultIdx < m_Results.size(); ++resultIdx)
+		{
+			const BenchmarkResult& result{ m_Results[resultIdx] };
+			file << "\t\t{ \"scene\": \"" << result.sceneName << "\""
+				<< ", \"width\": " << result.resolution.width
+				<< ", \"height\": " << result.resolution.height
+				<< ", \"threads\": " << result.threadCount
+				<< ", \"frames\": " << result.frameCount
+				<< ", \"medianMs\": " << result.medianMilliseconds
+				<< ", \"p95Ms\": " << result.p95Milliseconds
+				<< ", \"p99Ms\": " << result.p99Milliseconds
+				<< ", \"raysPerSecond\": " << result.raysPerSecond
+				<< ", \"primaryRays\": " << result.primaryRays
+				<< ", \"shadowRays\": " << result.shadowRays
+				<< " }" << (resultIdx + 1 < m_Results.size() ? "," : "") << "\n";
+		}
+		file << "\t]\n}\n";
+		return static_cast<bool>(file);
+	}
+
+	bool Benchmark::WriteCsv() const
+	{
+		std::ofstream file{ m_Settings.outputPath };
+		if (!file)
+			return false;
+
+		file << "scene,width,height,threads,frames,median_ms,p95_ms,p99_ms,rays_per_second,primary_rays,shadow_rays\n";
+		for (const BenchmarkResult& result : m_Results)
+		{
+			file << result.sceneName << "," << result.resolution.width << "," << result.resolution.height << "," << result.threadCount << ","
+				<< result.frameCount << "," << result.medianMilliseconds << "," << result.p95Milliseconds << "," << result.p99Milliseconds << ","
+				<< result.raysPerSecond << "," << result.primaryRays << "," << result.shadowRays << "\n";
+		}
+		return static_cast<bool>(file);
+	}
+
+	//Nearest rank percentile, sortedFrameTimes has to be sorted ascending
+	double Benchmark::GetPercentile(const std::vector<double>& sortedFrameTimes, float percentile)
+	{
+		if (sortedFrameTimes.empty())
+			return 0.0;
+
+		const int rank{ static_cast<int>(std::ceil(percentile * sortedFrameTimes.size())) };
+		return sortedFrameTimes[std::clamp(rank - 1, 0, static_cast<int>(sortedFrameTimes.size()) - 1)];
+	}
+}
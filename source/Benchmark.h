@@ -0,0 +1,70 @@
+#pragma once
+
+//Standard includes
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace dae
+{
+	struct BenchmarkResolution
+	{
+		int width{};
+		int height{};
+	};
+
+	struct BenchmarkSettings
+	{
+		std::vector<std::string> sceneNames{};
+		std::vector<BenchmarkResolution> resolutions{};
+		std::vector<int> threadCounts{};
+		int warmupFrames{ 2 };
+		int frameCount{ 20 };
+		std::string outputPath{ "benchmark.json" };
+	};
+
+	struct BenchmarkResult
+	{
+		std::string sceneName{};
+		BenchmarkResolution resolution{};
+		int threadCount{};
+		int frameCount{};
+
+		double medianMilliseconds{};
+		double p95Milliseconds{};
+		double p99Milliseconds{};
+		double raysPerSecond{};
+
+		//Totals over all measured frames
+		uint64_t primaryRays{};
+		uint64_t shadowRays{};
+	};
+
+	//Renders every scene at every resolution and thread count without a window and collects frame time statistics.
+	//The camera is never moved and the scene animation runs on a fixed time step, so runs of different builds are comparable.
+	class Benchmark final
+	{
+	public:
+		explicit Benchmark(const BenchmarkSettings& settings);
+		~Benchmark() = default;
+
+		Benchmark(const Benchmark&) = delete;
+		Benchmark(Benchmark&&) noexcept = delete;
+		Benchmark& operator=(const Benchmark&) = delete;
+		Benchmark& operator=(Benchmark&&) noexcept = delete;
+
+		//Runs all configurations and writes the results, CSV when the output path ends in .csv, JSON otherwise
+		bool Run();
+		const std::vector<BenchmarkResult>& GetResults() const { return m_Results; }
+
+	private:
+		BenchmarkSettings m_Settings{};
+		std::vector<BenchmarkResult> m_Results{};
+
+		bool RunConfiguration(const std::string& sceneName, const BenchmarkResolution& resolution, int threadCount);
+		bool WriteJson() const;
+		bool WriteCsv() const;
+
+		static double GetPercentile(const std::vector<double>& sortedFrameTimes, float percentile);
+	};
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <vector>
+
+#include "Math.h"
+
+namespace dae
+{
+	//Camera space directions through every pixel center (z = 1, not normalized), stored row-major.
+	//They only depend on the resolution and the field of view, so they are recalculated when one of those changes
+	//and every frame only rotates and normalizes them. Normalizing after the rotation keeps every direction
+	//bit for bit equal to calculating it from scratch, normalizing before it would change the last bits under a rotated camera.
+	class CameraRayGenerator final
+	{
+	public:
+		void Update(int width, int height, float fovAngle)
+		{
+			if (width == m_Width && height == m_Height && fovAngle == m_FovAngle)
+				return;
+
+			m_Width = width;
+			m_Height = height;
+			m_FovAngle = fovAngle;
+
+			m_AspectRatio = float(width) / float(height);
+			m_Fov = tanf((fovAngle * TO_RADIANS) / 2);
+
+			m_Directions.resize(static_cast<size_t>(width) * height);
+			for (int py{}; py < height; ++py)
+			{
+				for (int px{}; px < width; ++px)
+				{
+					m_Directions[px + (py * width)] = CalculateCameraDirection(px + 0.5f, py + 0.5f);
+				}
+			}
+		}
+
+		const Vector3& GetCameraDirection(int px, int py) const { return m_Directions[px + (py * m_Width)]; }
+
+		Vector3 GetWorldDirection(int px, int py, const Matrix& cameraToWorld) const
+		{
+			return cameraToWorld.TransformVector(GetCameraDirection(px, py)).Normalized();
+		}
+
+		//Direction through an arbitrary point of the pixel instead of its center, offsets are in [0, 1[
+		Vector3 GetWorldDirection(int px, int py, float offsetX, float offsetY, const Matrix& cameraToWorld) const
+		{
+			return cameraToWorld.TransformVector(CalculateCameraDirection(px + offsetX, py + offsetY)).Normalized();
+		}
+
+	private:
+		std::vector<Vector3> m_Directions{};
+
+		int m_Width{};
+		int m_Height{};
+		float m_FovAngle{};
+		float m_AspectRatio{};
+		float m_Fov{};
+
+		Vector3 CalculateCameraDirection(float x, float y) const
+		{
+			const float rayX{ (((2 * x) / m_Width) - 1) * m_AspectRatio * m_Fov };
+			const float rayY{ (1 - ((2 * y) / m_Height)) * m_Fov };
+			return Vector3{ rayX, rayY, 1.f };
+		}
+	};
+}
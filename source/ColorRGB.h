@@ -3,6 +3,8 @@
 
 namespace dae
 {
+	//Plain scalar code: --math-benchmark measures irradiance * BRDF * cosineLaw packed into an SSE register at about 0.7x
+	//of the scalar speed, moving the 12 byte color in and out of the register costs more than the multiplies it saves.
 	struct ColorRGB
 	{
 		float r{};
@@ -2,6 +2,8 @@
 #include <cassert>
 
 #include "Math.h"
+#include "BVH.h"
+#include "TriangleSoA.h"
 #include "vector"
 
 namespace dae
@@ -90,6 +92,16 @@ namespace dae
 		std::vector<Vector3> transformedPositions{};
 		std::vector<Vector3> transformedNormals{};
 
+		//Acceleration structure over transformedPositions (primitive index = triangle number)
+		BVH bvh{};
+		std::vector<AABB> triangleBounds{};
+
+		//Precomputed edges and normals in padded runs per BVH leaf, this is what the intersection tests read
+		TriangleSoA triangles{};
+
+		//Bumped every time the transformed geometry is recalculated
+		uint32_t version{};
+
 		void Translate(const Vector3& translation)
 		{
 			translationTransform = Matrix::CreateTranslation(translation);
@@ -160,6 +172,86 @@ namespace dae
 			{
 				transformedNormals.emplace_back(finalTransform.TransformVector(normals[idx]));
 			}
+
+			UpdateBVH();
+			++version;
+		}
+
+		void UpdateBVH()
+		{
+			CalculateTriangleBounds(transformedPositions);
+
+			//Moving the mesh only refits the existing tree, it is rebuilt when the triangles changed or the tree got too loose
+			if (bvh.GetPrimitiveCount() != static_cast<int>(triangleBounds.size()))
+			{
+				BuildBVH();
+			}
+			else
+			{
+				bvh.Refit(triangleBounds);
+				if (bvh.NeedsRebuild())
+					BuildBVH();
+			}
+
+			triangles.Update(transformedPositions, transformedNormals, indices, bvh);
+		}
+
+		//Bounds of every triangle over the given vertices (positions or transformedPositions)
+		void CalculateTriangleBounds(const std::vector<Vector3>& vertices)
+		{
+			const int triangleCount{ int(indices.size() / 3) };
+
+			triangleBounds.resize(triangleCount);
+			for (int triangleNr{}; triangleNr < triangleCount; ++triangleNr)
+			{
+				AABB& bounds{ triangleBounds[triangleNr] };
+				bounds = {};
+				bounds.Grow(vertices[indices[triangleNr * 3]]);
+				bounds.Grow(vertices[indices[triangleNr * 3 + 1]]);
+				bounds.Grow(vertices[indices[triangleNr * 3 + 2]]);
+			}
+		}
+
+		//Leaves hold up to two SIMD blocks of triangles, which are tested together
+		void BuildBVH()
+		{
+			bvh.Build(triangleBounds, 2 * TriangleSoA::Width, TriangleSoA::Width);
+		}
+	};
+
+	//Places a shared mesh in the world without copying its vertices, rays are moved into the space of the mesh instead.
+	//Moving an instance only changes its matrices, the mesh and its BVH are never touched.
+	struct TriangleMeshInstance
+	{
+		int meshIndex{};
+		unsigned char materialIndex{};
+
+		Matrix transform{};
+		Matrix inverseTransform{};
+		Matrix normalTransform{};
+
+		//Bumped every time the transform is set
+		uint32_t version{};
+
+		void SetTransform(const Matrix& _transform)
+		{
+			transform = _transform;
+			inverseTransform = Matrix::Inverse(transform);
+			normalTransform = Matrix::Transpose(inverseTransform);
+			++version;
+		}
+
+		AABB GetBounds(const AABB& meshBounds) const
+		{
+			AABB bounds{};
+			for (int corner{}; corner < 8; ++corner)
+			{
+				bounds.Grow(transform.TransformPoint(
+					(corner & 1) ? meshBounds.max.x : meshBounds.min.x,
+					(corner & 2) ? meshBounds.max.y : meshBounds.min.y,
+					(corner & 4) ? meshBounds.max.z : meshBounds.min.z));
+			}
+			return bounds;
 		}
 	};
 #pragma endregion
@@ -199,5 +291,37 @@ namespace dae
 		bool didHit{ false };
 		unsigned char materialIndex{ 0 };
 	};
+
+	enum class PrimitiveType : unsigned char
+	{
+		None,
+		Sphere,
+		Plane,
+		TriangleMesh,
+		TriangleMeshInstance,
+		Triangle
+	};
+
+	//What the closest hit search keeps of a hit, the surface data of the HitRecord is only rebuilt for the final one
+	struct HitCandidate
+	{
+		float t = FLT_MAX;
+
+		PrimitiveType primitiveType{ PrimitiveType::None };
+		int primitiveIdx{ -1 }; //index in the geometry list of its type
+		int triangleIdx{ -1 }; //triangle number in the (instanced) mesh
+
+		//Barycentric weights of the second and third corner, only set for triangles
+		float u{};
+		float v{};
+	};
+
+	//Primitive that blocked the last shadow ray towards a light, the next shadow ray towards that light tests it first
+	struct Occluder
+	{
+		PrimitiveType primitiveType{ PrimitiveType::None };
+		int primitiveIdx{ -1 }; //index in the geometry list of its type
+		int triangleIdx{ -1 }; //triangle number in the (instanced) mesh
+	};
 #pragma endregion
 }
\ No newline at end of file
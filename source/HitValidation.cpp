@@ -0,0 +1,270 @@
+#include "HitValidation.h"
+
+//Standard includes
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+//Project includes
+#include "CameraRayGenerator.h"
+#include "RayPacket.h"
+#include "Scene.h"
+#include "Timer.h"
+#include "Utils.h"
+
+namespace dae
+{
+	namespace
+	{
+		//Animation steps between two validated frames, so moved meshes and instances get refitted in between
+		constexpr int StepsPerFrame{ 15 };
+		constexpr int MaxReportedMismatches{ 10 };
+		//Light pdfs are products of ratios down the tree, in a different order than the sum over all lights
+		constexpr float MaxPdfError{ 0.001f };
+
+		struct ValidationResult
+		{
+			uint64_t queryCount{};
+			uint64_t mismatchCount{};
+			uint64_t tieCount{}; //same distance as the reference, but another primitive won
+		};
+
+		void ReportMismatch(const char* queryName, const Ray& ray, const std::string& result, const std::string& reference, ValidationResult& validationResult)
+		{
+			if (validationResult.mismatchCount++ >= MaxReportedMismatches)
+				return;
+
+			std::cout << "  " << queryName << " mismatch for origin (" << ray.origin.x << ", " << ray.origin.y << ", " << ray.origin.z
+				<< ") direction (" << ray.direction.x << ", " << ray.direction.y << ", " << ray.direction.z << ") max " << ray.max
+				<< ": " << result << ", reference " << reference << std::endl;
+		}
+
+		void ReportLightMismatch(const char* queryName, const HitRecord& hit, const std::string& result, const std::string& reference, ValidationResult& validationResult)
+		{
+			if (validationResult.mismatchCount++ >= MaxReportedMismatches)
+				return;
+
+			std::cout << "  " << queryName << " mismatch for point (" << hit.origin.x << ", " << hit.origin.y << ", " << hit.origin.z
+				<< ") normal (" << hit.normal.x << ", " << hit.normal.y << ", " << hit.normal.z << "): " << result << ", reference " << reference << std::endl;
+		}
+
+		std::string ToString(const HitRecord& hit)
+		{
+			return hit.didHit ? "t " + std::to_string(hit.t) + " material " + std::to_string(hit.materialIndex) : "miss";
+		}
+
+		void CompareClosestHit(const Scene& scene, const char* queryName, const Ray& ray, const HitRecord& hit, ValidationResult& result)
+		{
+			HitRecord reference{};
+			scene.GetClosestHitReference(ray, reference);
+			++result.queryCount;
+
+			//Both sides run the same intersection kernels, so the distances have to match exactly
+			if (hit.didHit != reference.didHit || (hit.didHit && hit.t != reference.t))
+			{
+				ReportMismatch(queryName, ray, ToString(hit), ToString(reference), result);
+				return;
+			}
+
+			if (hit.didHit && (hit.materialIndex != reference.materialIndex
+				|| hit.normal.x != reference.normal.x || hit.normal.y != reference.normal.y || hit.normal.z != reference.normal.z))
+			{
+				++result.tieCount;
+			}
+		}
+
+		void CompareAnyHit(const Scene& scene, const Ray& ray, ValidationResult& result)
+		{
+			const bool didHit{ scene.DoesHit(ray) };
+			const bool reference{ scene.DoesHitReference(ray) };
+			++result.queryCount;
+
+			if (didHit != reference)
+				ReportMismatch("any hit", ray, didHit ? "hit" : "miss", reference ? "hit" : "miss", result);
+		}
+
+		//Shadow ray query with the occluder the previous ray towards the same light left behind, like the renderer uses it
+		void CompareCachedAnyHit(const Scene& scene, const Ray& ray, Occluder& occluder, ValidationResult& result)
+		{
+			const bool didHit{ scene.DoesHit(ray, occluder) };
+			const bool reference{ scene.DoesHitReference(ray) };
+			++result.queryCount;
+
+			if (didHit != reference)
+				ReportMismatch("cached any hit", ray, didHit ? "hit" : "miss", reference ? "hit" : "miss", result);
+		}
+
+		//The light tree has to pick every point light that can light the surface, with pdfs that add up to one,
+		//and the pdf Sample returns has to be the one GetPdf replays for the chosen light
+		void ValidateLightPdfs(const Scene& scene, const HitRecord& hit, std::mt19937& random, ValidationResult& result)
+		{
+			const LightTree& lightTree{ scene.GetLightTree() };
+			if (lightTree.IsEmpty())
+				return;
+
+			const std::vector<Light>& lights{ scene.GetLights() };
+			float pdfSum{};
+			bool canBeLit{};
+			for (int lightIdx{}; lightIdx < static_cast<int>(lights.size()); ++lightIdx)
+			{
+				const Light& light{ lights[lightIdx] };
+				if (light.type != LightType::Point)
+					continue;
+
+				const float pdf{ lightTree.GetPdf(lightIdx, hit.origin, hit.normal) };
+				const ColorRGB radiance{ LightUtils::GetRadiance(light, hit.origin) };
+				const bool canLight{ Vector3::Dot(hit.normal, light.origin - hit.origin) >= 0.f && radiance.r + radiance.g + radiance.b > 0.f };
+				canBeLit = canBeLit || canLight;
+				pdfSum += pdf;
+
+				++result.queryCount;
+				if (canLight != (pdf > 0.f))
+					ReportLightMismatch("light pdf", hit, "light " + std::to_string(lightIdx) + " pdf " + std::to_string(pdf),
+						canLight ? "lit" : "unlit", result);
+			}
+
+			++result.queryCount;
+			if (std::abs(pdfSum - (canBeLit ? 1.f : 0.f)) > MaxPdfError)
+				ReportLightMismatch("light pdf sum", hit, std::to_string(pdfSum), canBeLit ? "1" : "0", result);
+
+			std::uniform_real_distribution<float> distribution{ 0.f, 1.f };
+			float pdf{};
+			const int lightIdx{ lightTree.Sample(hit.origin, hit.normal, distribution(random), pdf) };
+			const float reference{ lightTree.GetPdf(lightIdx, hit.origin, hit.normal) };
+			++result.queryCount;
+			if ((lightIdx < 0) == canBeLit || std::abs(pdf - reference) > MaxPdfError * reference)
+				ReportLightMismatch("sampled light pdf", hit, "light " + std::to_string(lightIdx) + " pdf " + std::to_string(pdf),
+					"pdf " + std::to_string(reference), result);
+		}
+
+		//Shadow rays towards every light and a bounce ray in a random direction, all leaving the surface like the renderer does
+		void ValidateSecondaryRays(const Scene& scene, const HitRecord& hit, std::vector<Occluder>& occluders, std::mt19937& random, ValidationResult& result)
+		{
+			const Vector3 offsetOrigin{ hit.origin + hit.normal * 0.001f };
+			HitRecord secondaryHit{};
+
+			const std::vector<Light>& lights{ scene.GetLights() };
+			for (size_t lightIdx{}; lightIdx < lights.size(); ++lightIdx)
+			{
+				Vector3 lightDirection{ LightUtils::GetDirectionToLight(lights[lightIdx], hit.origin) };
+				const float lightDistance{ lightDirection.Normalize() };
+				const Ray lightRay{ offsetOrigin, lightDirection, 0.0001f, lightDistance };
+
+				CompareAnyHit(scene, lightRay, result);
+				CompareCachedAnyHit(scene, lightRay, occluders[lightIdx], result);
+
+				secondaryHit = {};
+				scene.GetClosestHit(lightRay, secondaryHit);
+				CompareClosestHit(scene, "shadow ray closest hit", lightRay, secondaryHit, result);
+			}
+
+			std::uniform_real_distribution<float> distribution{ -1.f, 1.f };
+			Vector3 bounceDirection{ distribution(random), distribution(random), distribution(random) };
+			if (bounceDirection.SqrMagnitude() < 0.0001f)
+				return;
+
+			bounceDirection.Normalize();
+			if (Vector3::Dot(bounceDirection, hit.normal) < 0.f)
+				bounceDirection = bounceDirection * -1.f;
+
+			const Ray bounceRay{ offsetOrigin, bounceDirection };
+			secondaryHit = {};
+			scene.GetClosestHit(bounceRay, secondaryHit);
+			CompareClosestHit(scene, "bounce closest hit", bounceRay, secondaryHit, result);
+			CompareAnyHit(scene, bounceRay, result);
+		}
+
+		void ValidateFrame(Scene& scene, int width, int height, std::mt19937& random, ValidationResult& result)
+		{
+			scene.UpdateAccelerationStructure();
+
+			Camera& camera{ scene.GetCamera() };
+			const Matrix cameraToWorld{ camera.CalculateCameraToWorld() };
+
+			CameraRayGenerator rayGenerator{};
+			rayGenerator.Update(width, height, camera.fovAngle);
+
+			std::vector<Occluder> occluders(scene.GetLights().size());
+
+			//Primary rays go through the packet query like the renderer traces them and through the single ray queries
+			for (int blockY{}; blockY < height; blockY += RayPacket::Width)
+			{
+				for (int blockX{}; blockX < width; blockX += RayPacket::Width)
+				{
+					RayPacket packet{};
+					for (int lane{}; lane < RayPacket::Size; ++lane)
+					{
+						const int px{ blockX + lane % RayPacket::Width };
+						const int py{ blockY + lane / RayPacket::Width };
+						if (px < width && py < height)
+							packet.SetRay(lane, camera.origin, rayGenerator.GetWorldDirection(px, py, cameraToWorld));
+					}
+
+					HitRecord packetHits[RayPacket::Size]{};
+					scene.GetClosestHit(packet, packetHits);
+
+					for (int lane{}; lane < RayPacket::Size; ++lane)
+					{
+						if ((packet.activeMask & (1u << lane)) == 0)
+							continue;
+
+						const Ray ray{ packet.GetOrigin(lane), packet.GetDirection(lane) };
+						CompareClosestHit(scene, "packet closest hit", ray, packetHits[lane], result);
+
+						HitRecord hit{};
+						scene.GetClosestHit(ray, hit);
+						CompareClosestHit(scene, "closest hit", ray, hit, result);
+						CompareAnyHit(scene, ray, result);
+
+						if (hit.didHit)
+						{
+							ValidateSecondaryRays(scene, hit, occluders, random, result);
+							ValidateLightPdfs(scene, hit, random, result);
+						}
+					}
+				}
+			}
+		}
+	}
+
+	bool RunHitValidation(int width, int height, int frameCount)
+	{
+		bool isValid{ true };
+		for (const std::string& sceneName : GetSceneNames())
+		{
+			Scene* pScene{ CreateScene(sceneName) };
+			pScene->Initialize();
+
+			const auto pTimer = new Timer();
+			pTimer->SetFixedTimeStep(1.f / 30.f);
+			pTimer->Start();
+
+			std::mt19937 random{ 1 };
+			ValidationResult result{};
+			for (int frameIdx{}; frameIdx < frameCount; ++frameIdx)
+			{
+				for (int stepIdx{}; stepIdx < (frameIdx == 0 ? 1 : StepsPerFrame); ++stepIdx)
+				{
+					pScene->Update(pTimer);
+					pTimer->Update();
+				}
+
+				ValidateFrame(*pScene, width, height, random, result);
+			}
+			pTimer->Stop();
+
+			std::cout << sceneName << ": " << result.queryCount << " queries, " << result.mismatchCount << " mismatches, "
+				<< result.tieCount << " ties" << std::endl;
+			isValid = isValid && result.mismatchCount == 0;
+
+			delete pTimer;
+			delete pScene;
+		}
+
+		std::cout << (isValid ? "Hit validation passed" : "Hit validation FAILED") << std::endl;
+		return isValid;
+	}
+}
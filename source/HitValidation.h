@@ -0,0 +1,10 @@
+#pragma once
+
+namespace dae
+{
+	//Traces camera rays (single and in packets), shadow rays and random bounce rays through every scene over a few animation steps
+	//and compares the accelerated closest hit and any hit queries with the brute force reference queries of the scene.
+	//At every primary hit it also checks that the light tree pdfs of the point lights add up to one.
+	//Prints the mismatches and returns false if there was one.
+	bool RunHitValidation(int width = 160, int height = 120, int frameCount = 3);
+}
@@ -0,0 +1,252 @@
+#include "LightTree.h"
+
+//Standard includes
+#include <algorithm>
+#include <cmath>
+
+//Project includes
+#include "Utils.h"
+
+namespace dae
+{
+	namespace
+	{
+		//Keeps the importance of a light the shaded point sits on finite
+		constexpr float MinSqrDistance{ 0.0001f };
+		//Size of the build boxes around the lights, relative to the diagonal of all point lights
+		constexpr float LightPadding{ 0.01f };
+		//Largest float below 1, rescaled samples must stay inside [0, 1)
+		constexpr float OneMinusEpsilon{ 0x1.fffffep-1f };
+
+		float GetLuminance(const ColorRGB& color)
+		{
+			return 0.2126f * color.r + 0.7152f * color.g + 0.0722f * color.b;
+		}
+	}
+
+	void LightTree::Update(const std::vector<Light>& lights)
+	{
+		const bool isUnchanged{ lights.size() == m_BuiltLights.size()
+			&& std::equal(lights.begin(), lights.end(), m_BuiltLights.begin(), [](const Light& light, const Light& builtLight)
+				{
+					return light.type == builtLight.type && light.intensity == builtLight.intensity
+						&& light.color.r == builtLight.color.r && light.color.g == builtLight.color.g && light.color.b == builtLight.color.b
+						&& light.origin.x == builtLight.origin.x && light.origin.y == builtLight.origin.y && light.origin.z == builtLight.origin.z;
+				}) };
+
+		if (isUnchanged)
+			return;
+
+		m_BuiltLights = lights;
+		Build(lights);
+	}
+
+	void LightTree::Build(const std::vector<Light>& lights)
+	{
+		m_PointLights.clear();
+		m_DirectionalLights.clear();
+		m_LightBounds.clear();
+		m_LightLeaves.assign(lights.size(), -1);
+
+		for (int lightIdx{}; lightIdx < static_cast<int>(lights.size()); ++lightIdx)
+		{
+			const Light& light{ lights[lightIdx] };
+			if (light.type != LightType::Point)
+			{
+				m_DirectionalLights.push_back(lightIdx);
+				continue;
+			}
+
+			AABB bounds{};
+			bounds.Grow(light.origin);
+			m_LightBounds.push_back(bounds);
+			m_PointLights.push_back(lightIdx);
+		}
+
+		//Points have no surface area, so the SAH sees every split as free and builds a lopsided tree.
+		//Small equal boxes around the lights let it balance the splits, the nodes get the bounds of the lights themselves below.
+		AABB allBounds{};
+		for (const AABB& bounds : m_LightBounds)
+		{
+			allBounds.Grow(bounds);
+		}
+		const float padding{ LightPadding * (allBounds.max - allBounds.min).Magnitude() };
+		for (AABB& bounds : m_LightBounds)
+		{
+			bounds.min = bounds.min - Vector3{ padding, padding, padding };
+			bounds.max = bounds.max + Vector3{ padding, padding, padding };
+		}
+
+		//One light per leaf, only lights at the same position end up sharing one
+		m_Tree.Build(m_LightBounds, 1);
+
+		//Children are always stored after their parent, so walking backwards sums them up first
+		const std::vector<BVHNode>& nodes{ m_Tree.GetNodes() };
+		const std::vector<int>& primitiveIndices{ m_Tree.GetPrimitiveIndices() };
+		m_Nodes.resize(nodes.size());
+		for (int nodeIdx{ static_cast<int>(nodes.size()) - 1 }; nodeIdx >= 0; --nodeIdx)
+		{
+			const BVHNode& node{ nodes[nodeIdx] };
+			LightNode& lightNode{ m_Nodes[nodeIdx] };
+			lightNode.leftFirst = node.leftFirst;
+			lightNode.primitiveCount = node.primitiveCount;
+			lightNode.power = 0.f;
+
+			AABB bounds{};
+			if (node.IsLeaf())
+			{
+				for (int idx{ node.leftFirst }; idx < node.leftFirst + node.primitiveCount; ++idx)
+				{
+					const int lightIdx{ m_PointLights[primitiveIndices[idx]] };
+					bounds.Grow(lights[lightIdx].origin);
+					lightNode.power += GetPower(lights[lightIdx]);
+					m_LightLeaves[lightIdx] = nodeIdx;
+				}
+			}
+			else
+			{
+				for (LightNode* pChild : { &m_Nodes[node.leftFirst], &m_Nodes[node.leftFirst + 1] })
+				{
+					bounds.Grow(pChild->center - pChild->halfExtent);
+					bounds.Grow(pChild->center + pChild->halfExtent);
+					lightNode.power += pChild->power;
+					pChild->parent = nodeIdx;
+				}
+			}
+
+			lightNode.center = bounds.GetCenter();
+			lightNode.halfExtent = (bounds.max - bounds.min) * 0.5f;
+			lightNode.minSqrDistance = std::max(lightNode.halfExtent.SqrMagnitude(), MinSqrDistance);
+		}
+	}
+
+	int LightTree::Sample(const Vector3& point, const Vector3& normal, float sample, float& pdf) const
+	{
+		pdf = 0.f;
+		if (m_Nodes.empty())
+			return -1;
+
+		//Every step spends part of the sample on the choice and rescales the rest, so one number drives the whole descent.
+		//Which child wins is a coin flip, the selects keep the descent free of branches the CPU can't predict.
+		float probability{ 1.f };
+		int nodeIdx{};
+		while (m_Nodes[nodeIdx].primitiveCount == 0)
+		{
+			const int leftIdx{ m_Nodes[nodeIdx].leftFirst };
+			float leftImportance{};
+			float rightImportance{};
+			GetChildImportances(m_Nodes[nodeIdx], point, normal, leftImportance, rightImportance);
+			const float importance{ leftImportance + rightImportance };
+			if (importance <= 0.f)
+				return -1;
+
+			const float scaledSample{ sample * importance };
+			const bool isLeft{ scaledSample < leftImportance };
+			const float childImportance{ isLeft ? leftImportance : rightImportance };
+
+			sample = std::min((isLeft ? scaledSample : scaledSample - leftImportance) / childImportance, OneMinusEpsilon);
+			probability *= childImportance / importance;
+			nodeIdx = isLeft ? leftIdx : leftIdx + 1;
+		}
+
+		//Lights sharing a leaf sit at the same position, their radiance at the point decides
+		const LightNode& leaf{ m_Nodes[nodeIdx] };
+		const std::vector<int>& primitiveIndices{ m_Tree.GetPrimitiveIndices() };
+		float leafImportance{};
+		for (int idx{ leaf.leftFirst }; idx < leaf.leftFirst + leaf.primitiveCount; ++idx)
+		{
+			leafImportance += GetImportance(m_BuiltLights[m_PointLights[primitiveIndices[idx]]], point, normal);
+		}
+		if (leafImportance <= 0.f)
+			return -1;
+
+		float threshold{ sample * leafImportance };
+		int lightIdx{ -1 };
+		for (int idx{ leaf.leftFirst }; idx < leaf.leftFirst + leaf.primitiveCount; ++idx)
+		{
+			const float importance{ GetImportance(m_BuiltLights[m_PointLights[primitiveIndices[idx]]], point, normal) };
+			if (importance <= 0.f)
+				continue;
+
+			lightIdx = m_PointLights[primitiveIndices[idx]];
+			pdf = probability * importance / leafImportance;
+			if (threshold < importance)
+				break;
+			threshold -= importance;
+		}
+
+		return lightIdx;
+	}
+
+	//Replays the choices Sample makes from the leaf of the light up to the root
+	float LightTree::GetPdf(int lightIdx, const Vector3& point, const Vector3& normal) const
+	{
+		if (lightIdx < 0 || lightIdx >= static_cast<int>(m_LightLeaves.size()) || m_LightLeaves[lightIdx] < 0)
+			return 0.f;
+
+		int nodeIdx{ m_LightLeaves[lightIdx] };
+		const LightNode& leaf{ m_Nodes[nodeIdx] };
+		const std::vector<int>& primitiveIndices{ m_Tree.GetPrimitiveIndices() };
+		float leafImportance{};
+		float lightImportance{};
+		for (int idx{ leaf.leftFirst }; idx < leaf.leftFirst + leaf.primitiveCount; ++idx)
+		{
+			const float importance{ GetImportance(m_BuiltLights[m_PointLights[primitiveIndices[idx]]], point, normal) };
+			leafImportance += importance;
+			if (m_PointLights[primitiveIndices[idx]] == lightIdx)
+				lightImportance = importance;
+		}
+		if (lightImportance <= 0.f)
+			return 0.f;
+
+		float pdf{ lightImportance / leafImportance };
+		for (int parentIdx{ leaf.parent }; parentIdx >= 0; nodeIdx = parentIdx, parentIdx = m_Nodes[parentIdx].parent)
+		{
+			float leftImportance{};
+			float rightImportance{};
+			GetChildImportances(m_Nodes[parentIdx], point, normal, leftImportance, rightImportance);
+			const float importance{ leftImportance + rightImportance };
+			if (importance <= 0.f)
+				return 0.f;
+
+			pdf *= (nodeIdx == m_Nodes[parentIdx].leftFirst ? leftImportance : rightImportance) / importance;
+		}
+		return pdf;
+	}
+
+	//Power over squared distance, both scaled by the product of the distances so only the ratio costs a division
+	void LightTree::GetChildImportances(const LightNode& node, const Vector3& point, const Vector3& normal, float& leftImportance, float& rightImportance) const
+	{
+		float leftSqrDistance{};
+		float rightSqrDistance{};
+		const float leftPower{ GetReachingPower(m_Nodes[node.leftFirst], point, normal, leftSqrDistance) };
+		const float rightPower{ GetReachingPower(m_Nodes[node.leftFirst + 1], point, normal, rightSqrDistance) };
+
+		leftImportance = leftPower * rightSqrDistance;
+		rightImportance = rightPower * leftSqrDistance;
+	}
+
+	//The importance of a node is the radiance it can deliver at the point: this power over the squared distance to its center,
+	//where a point inside the bounds counts as half a diagonal away. The power is zero when the whole box lies behind the surface.
+	float LightTree::GetReachingPower(const LightNode& node, const Vector3& point, const Vector3& normal, float& sqrDistance)
+	{
+		const Vector3 toCenter{ node.center - point };
+		const float maxDot{ Vector3::Dot(normal, toCenter)
+			+ std::abs(normal.x) * node.halfExtent.x + std::abs(normal.y) * node.halfExtent.y + std::abs(normal.z) * node.halfExtent.z };
+
+		sqrDistance = std::max(toCenter.SqrMagnitude(), node.minSqrDistance);
+		return maxDot < 0.f ? 0.f : node.power;
+	}
+
+	//Radiance at the point, zero for lights behind the surface
+	float LightTree::GetImportance(const Light& light, const Vector3& point, const Vector3& normal)
+	{
+		return Vector3::Dot(normal, light.origin - point) >= 0.f ? GetLuminance(LightUtils::GetRadiance(light, point)) : 0.f;
+	}
+
+	//Radiance at unit distance, the same luminance weighting the leaves apply to GetRadiance
+	float LightTree::GetPower(const Light& light)
+	{
+		return GetLuminance(light.color) * light.intensity;
+	}
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <vector>
+
+#include "Math.h"
+#include "BVH.h"
+#include "DataTypes.h"
+
+namespace dae
+{
+	//Hierarchy over the point lights of a scene, every node knows the summed power of the lights below it.
+	//Sampling walks down from the root and picks a child in proportion to how much it can light the shaded point,
+	//so one light is chosen out of hundreds in O(log n) without looking at the others.
+	//Directional lights can't be bounded or ranked by distance and are kept in a separate list.
+	class LightTree final
+	{
+	public:
+		//Rebuilds the tree when the lights differ from the ones of the last build, cheap to call every frame
+		void Update(const std::vector<Light>& lights);
+
+		bool IsEmpty() const { return m_Tree.IsEmpty(); }
+		//Indices of the directional lights in the scene light list
+		const std::vector<int>& GetDirectionalLights() const { return m_DirectionalLights; }
+
+		/**
+		 * \brief Picks a point light by its importance for a surface point: radiance at the point, zero for lights behind the surface
+		 * \param sample uniform random number in [0, 1)
+		 * \param pdf probability with which the returned light was picked
+		 * \return index in the scene light list, -1 when no point light can reach the point
+		 */
+		int Sample(const Vector3& point, const Vector3& normal, float sample, float& pdf) const;
+		//Probability with which Sample picks the light at this surface point, zero for directional lights and lights it never picks
+		float GetPdf(int lightIdx, const Vector3& point, const Vector3& normal) const;
+
+	private:
+		//What sampling reads of a BVH node, in one place
+		struct LightNode
+		{
+			Vector3 center{};
+			float power{}; //luminance weighted intensity summed over the lights below the node
+			Vector3 halfExtent{};
+			float minSqrDistance{}; //points closer than this to the center are treated as this far away
+			int leftFirst{};
+			int primitiveCount{};
+			int parent{ -1 };
+		};
+
+		BVH m_Tree{};
+		std::vector<LightNode> m_Nodes{};
+		std::vector<int> m_PointLights{}; //BVH primitive index > scene light index
+		std::vector<int> m_DirectionalLights{};
+		std::vector<int> m_LightLeaves{}; //scene light index > leaf node, -1 for directional lights
+
+		//Lights of the last build, to notice changes
+		std::vector<Light> m_BuiltLights{};
+		std::vector<AABB> m_LightBounds{};
+
+		void Build(const std::vector<Light>& lights);
+		void GetChildImportances(const LightNode& node, const Vector3& point, const Vector3& normal, float& leftImportance, float& rightImportance) const;
+		static float GetReachingPower(const LightNode& node, const Vector3& point, const Vector3& normal, float& sqrDistance);
+		static float GetImportance(const Light& light, const Vector3& point, const Vector3& normal);
+		static float GetPower(const Light& light);
+	};
+}
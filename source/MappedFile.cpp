@@ -0,0 +1,86 @@
+#include "MappedFile.h"
+
+//Platform includes
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace dae
+{
+#ifdef _WIN32
+	MappedFile::MappedFile(const std::string& filename)
+	{
+		const HANDLE file{ CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr) };
+		if (file == INVALID_HANDLE_VALUE)
+			return;
+		m_pFile = file;
+
+		LARGE_INTEGER fileSize{};
+		if (!GetFileSizeEx(file, &fileSize))
+			return;
+
+		//Empty files can't be mapped, there is just nothing to read
+		m_Size = static_cast<size_t>(fileSize.QuadPart);
+		m_IsValid = true;
+		if (m_Size == 0)
+			return;
+
+		m_pMapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (m_pMapping)
+			m_pData = static_cast<const char*>(MapViewOfFile(m_pMapping, FILE_MAP_READ, 0, 0, 0));
+
+		m_IsValid = m_pData != nullptr;
+	}
+
+	MappedFile::~MappedFile()
+	{
+		if (m_pData)
+			UnmapViewOfFile(m_pData);
+		if (m_pMapping)
+			CloseHandle(m_pMapping);
+		if (m_pFile)
+			CloseHandle(m_pFile);
+	}
+#else
+	MappedFile::MappedFile(const std::string& filename)
+	{
+		const int fileDescriptor{ open(filename.c_str(), O_RDONLY) };
+		if (fileDescriptor < 0)
+			return;
+
+		struct stat fileStat {};
+		if (fstat(fileDescriptor, &fileStat) == 0)
+		{
+			//Empty files can't be mapped, there is just nothing to read
+			m_Size = static_cast<size_t>(fileStat.st_size);
+			m_IsValid = true;
+			if (m_Size > 0)
+			{
+				void* pMapping{ mmap(nullptr, m_Size, PROT_READ, MAP_PRIVATE, fileDescriptor, 0) };
+				if (pMapping != MAP_FAILED)
+				{
+					madvise(pMapping, m_Size, MADV_SEQUENTIAL);
+					m_pData = static_cast<const char*>(pMapping);
+				}
+				m_IsValid = m_pData != nullptr;
+			}
+		}
+
+		//The mapping keeps its own reference to the file
+		close(fileDescriptor);
+	}
+
+	MappedFile::~MappedFile()
+	{
+		if (m_pData)
+			munmap(const_cast<char*>(m_pData), m_Size);
+	}
+#endif
+}
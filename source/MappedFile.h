@@ -0,0 +1,36 @@
+#pragma once
+
+//Standard includes
+#include <string>
+
+namespace dae
+{
+	//Read only view of a whole file, the pages are only loaded when they are touched
+	class MappedFile final
+	{
+	public:
+		explicit MappedFile(const std::string& filename);
+		~MappedFile();
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile(MappedFile&&) noexcept = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+		MappedFile& operator=(MappedFile&&) noexcept = delete;
+
+		//Empty files are valid but have no data
+		bool IsValid() const { return m_IsValid; }
+		const char* GetData() const { return m_pData; }
+		size_t GetSize() const { return m_Size; }
+
+	private:
+		const char* m_pData{};
+		size_t m_Size{};
+		bool m_IsValid{};
+
+#ifdef _WIN32
+		//File and mapping handles, kept as void* so this header doesn't pull in Windows.h
+		void* m_pFile{};
+		void* m_pMapping{};
+#endif
+	};
+}
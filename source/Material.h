@@ -1,11 +1,113 @@
 #pragma once
+#include <cstdint>
+
 #include "Math.h"
 #include "DataTypes.h"
 #include "BRDFs.h"
 
 namespace dae
 {
+#pragma region Material DATA
+	enum class MaterialType : uint8_t
+	{
+		SolidColor,
+		Lambert,
+		LambertPhong,
+		CookTorrence
+	};
+	constexpr int MaterialTypeCount{ 4 };
+
+	//Every material packed into the same small struct, the scene keeps them in one contiguous table
+	//indexed by HitRecord::materialIndex. Fields a type doesn't use stay zero.
+	struct MaterialData
+	{
+		ColorRGB color{}; //solid color, diffuse color or albedo
+		float diffuseReflectance{}; //kd
+		float specularReflectance{}; //ks
+		float phongExponent{};
+		float metalness{};
+		float roughness{};
+		MaterialType type{ MaterialType::SolidColor };
+	};
+
+	namespace MaterialShading
+	{
+		//BRDF kernels per material type, no virtual calls so they inline into the shading loops
+		//n: surface normal, l: light direction, v: view direction
+		inline ColorRGB Shade_SolidColor(const MaterialData& material)
+		{
+			return material.color;
+		}
+
+		inline ColorRGB Shade_Lambert(const MaterialData& material)
+		{
+			return BRDF::Lambert(material.diffuseReflectance, material.color);
+		}
+
+		inline ColorRGB Shade_LambertPhong(const MaterialData& material, const Vector3& n, const Vector3& l, const Vector3& v)
+		{
+			return BRDF::Lambert(material.diffuseReflectance, material.color)
+				+ BRDF::Phong(material.specularReflectance, material.phongExponent, l, -v, n);
+		}
+
+		inline ColorRGB Shade_CookTorrence(const MaterialData& material, const Vector3& n, const Vector3& l, const Vector3& v)
+		{
+			if (material.roughness < 0.1f)
+			{
+				return {};
+			}
+
+			ColorRGB f0;
+			if (int(material.metalness) == 1)
+			{
+				f0 = material.color;
+			}
+			else
+			{
+				f0 = ColorRGB(0.04f, 0.04f, 0.04f);
+			}
+
+			const Vector3 h{ (v + l) / (v + l).Magnitude() };
+			const auto f = BRDF::FresnelFunction_Schlick(h, v, f0);
+			const auto d = BRDF::NormalDistribution_GGX(n, h, material.roughness);
+			const auto g = BRDF::GeometryFunction_Smith(n, v, l, material.roughness);
+
+			const ColorRGB dfg = { d * f.r * g, d * f.g * g, d * f.b * g };
+
+			const float vn = Vector3::Dot(v, n);
+			const float ln = Vector3::Dot(l, n);
+
+			const ColorRGB specular = { dfg.r / (4 * vn * ln), dfg.g / (4 * vn * ln), dfg.b / (4 * vn * ln) };
+
+			const ColorRGB kd = ColorRGB{ 1,1,1 } - f;
+
+			const ColorRGB diffuse = BRDF::Lambert(kd, material.color);
+
+			return { diffuse + specular };
+		}
+
+		//Single hit version for code that doesn't batch by type
+		inline ColorRGB Shade(const MaterialData& material, const Vector3& n, const Vector3& l, const Vector3& v)
+		{
+			switch (material.type)
+			{
+			case MaterialType::SolidColor:
+				return Shade_SolidColor(material);
+			case MaterialType::Lambert:
+				return Shade_Lambert(material);
+			case MaterialType::LambertPhong:
+				return Shade_LambertPhong(material, n, l, v);
+			case MaterialType::CookTorrence:
+				return Shade_CookTorrence(material, n, l, v);
+			}
+			return {};
+		}
+	}
+#pragma endregion
+
 #pragma region Material BASE
+	//Materials are only used to describe a material when building a scene,
+	//Scene::AddMaterial copies their data into the material table that shading reads from
 	class Material
 	{
 	public:
@@ -17,14 +119,10 @@ namespace dae
 		Material& operator=(const Material&) = delete;
 		Material& operator=(Material&&) noexcept = delete;
 
-		/**
-		 * \brief Function used to calculate the correct color for the specific material and its parameters
-		 * \param hitRecord current hitrecord
-		 * \param l light direction
-		 * \param v view direction
-		 * \return color
-		 */
-		virtual ColorRGB Shade(const HitRecord& hitRecord = {}, const Vector3& l = {}, const Vector3& v = {}) = 0;
+		const MaterialData& GetData() const { return m_Data; }
+
+	protected:
+		MaterialData m_Data{};
 	};
 #pragma endregion
 
@@ -34,17 +132,11 @@ namespace dae
 	class Material_SolidColor final : public Material
 	{
 	public:
-		Material_SolidColor(const ColorRGB& color): m_Color(color)
+		Material_SolidColor(const ColorRGB& color)
 		{
+			m_Data.type = MaterialType::SolidColor;
+			m_Data.color = color;
 		}
-
-		ColorRGB Shade(const HitRecord& hitRecord, const Vector3& l, const Vector3& v) override
-		{
-			return m_Color;
-		}
-
-	private:
-		ColorRGB m_Color{colors::White};
 	};
 #pragma endregion
 
@@ -54,19 +146,12 @@ namespace dae
 	class Material_Lambert final : public Material
 	{
 	public:
-		Material_Lambert(const ColorRGB& diffuseColor, float diffuseReflectance) :
-			m_DiffuseColor(diffuseColor), m_DiffuseReflectance(diffuseReflectance){}
-
-		ColorRGB Shade(const HitRecord& hitRecord = {}, const Vector3& l = {}, const Vector3& v = {}) override
+		Material_Lambert(const ColorRGB& diffuseColor, float diffuseReflectance)
 		{
-			//todo: W3
-			//assert(false && "Not Implemented Yet");
-			return BRDF::Lambert(m_DiffuseReflectance,m_DiffuseColor);
+			m_Data.type = MaterialType::Lambert;
+			m_Data.color = diffuseColor;
+			m_Data.diffuseReflectance = diffuseReflectance; //kd
 		}
-
-	private:
-		ColorRGB m_DiffuseColor{colors::White};
-		float m_DiffuseReflectance{1.f}; //kd
 	};
 #pragma endregion
 
@@ -76,25 +161,14 @@ namespace dae
 	class Material_LambertPhong final : public Material
 	{
 	public:
-		Material_LambertPhong(const ColorRGB& diffuseColor, float kd, float ks, float phongExponent):
-			m_DiffuseColor(diffuseColor), m_DiffuseReflectance(kd), m_SpecularReflectance(ks),
-			m_PhongExponent(phongExponent)
+		Material_LambertPhong(const ColorRGB& diffuseColor, float kd, float ks, float phongExponent)
 		{
+			m_Data.type = MaterialType::LambertPhong;
+			m_Data.color = diffuseColor;
+			m_Data.diffuseReflectance = kd;
+			m_Data.specularReflectance = ks;
+			m_Data.phongExponent = phongExponent;
 		}
-
-		ColorRGB Shade(const HitRecord& hitRecord = {}, const Vector3& l = {}, const Vector3& v = {}) override
-		{
-			//todo: W3
-			//assert(false && "Not Implemented Yet");
-			return BRDF::Lambert(m_DiffuseReflectance, m_DiffuseColor)
-				+ BRDF::Phong(m_SpecularReflectance, m_PhongExponent, l, -v, hitRecord.normal);
-		}
-
-	private:
-		ColorRGB m_DiffuseColor{colors::White};
-		float m_DiffuseReflectance{0.5f}; //kd
-		float m_SpecularReflectance{0.5f}; //ks
-		float m_PhongExponent{1.f}; //Phong Exponent
 	};
 #pragma endregion
 
@@ -103,53 +177,14 @@ namespace dae
 	class Material_CookTorrence final : public Material
 	{
 	public:
-		Material_CookTorrence(const ColorRGB& albedo, float metalness, float roughness):
-			m_Albedo(albedo), m_Metalness(metalness), m_Roughness(roughness)
+		//roughness [1.0 > 0.0] >> [ROUGH > SMOOTH]
+		Material_CookTorrence(const ColorRGB& albedo, float metalness, float roughness)
 		{
+			m_Data.type = MaterialType::CookTorrence;
+			m_Data.color = albedo;
+			m_Data.metalness = metalness;
+			m_Data.roughness = roughness;
 		}
-
-		ColorRGB Shade(const HitRecord& hitRecord = {}, const Vector3& l = {}, const Vector3& v = {}) override
-		{
-			//todo: W3
-			//assert(false && "Not Implemented Yet");
-			if(m_Roughness < 0.1f)
-			{
-				return {};
-			}
-			
-			ColorRGB f0;
-			if (int(m_Metalness) == 1)
-			{
-				f0 = m_Albedo;
-			}
-			else
-			{
-				f0 = ColorRGB(0.04f, 0.04f, 0.04f);
-			}
-			
-			const Vector3 h{ (v + l) / (v + l).Magnitude()};
-			const auto f = BRDF::FresnelFunction_Schlick(h, v, f0);
-			const auto d = BRDF::NormalDistribution_GGX(hitRecord.normal, h, m_Roughness);
-			const auto g = BRDF::GeometryFunction_Smith(hitRecord.normal, v, l, m_Roughness);
-			
-			const ColorRGB dfg = { d * f.r * g, d * f.g * g, d * f.b * g };
-			
-			const float vn = Vector3::Dot(v, hitRecord.normal);
-			const float ln = Vector3::Dot(l, hitRecord.normal);
-			
-			const ColorRGB specular = { dfg.r / (4 * vn * ln), dfg.g / (4 * vn * ln), dfg.b / (4 * vn * ln) };
-			
-			const ColorRGB kd = ColorRGB{ 1,1,1 } - f;
-			
-			const ColorRGB diffuse = BRDF::Lambert(kd, m_Albedo);
-			
-			return { diffuse + specular };
-		}
-
-	private:
-		ColorRGB m_Albedo{0.955f, 0.637f, 0.538f}; //Copper
-		float m_Metalness{1.0f};
-		float m_Roughness{0.1f}; // [1.0 > 0.0] >> [ROUGH > SMOOTH]
 	};
 #pragma endregion
 }
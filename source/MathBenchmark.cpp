@@ -0,0 +1,290 @@
+#include "MathBenchmark.h"
+
+//Standard includes
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+//Project includes
+#include "Math.h"
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+#define MATH_BENCHMARK_NOINLINE __declspec(noinline)
+#else
+#define MATH_BENCHMARK_NOINLINE __attribute__((noinline))
+#endif
+
+namespace dae
+{
+	namespace
+	{
+		//The implementations as they were when they still lived in the .cpp files.
+		//Kept out of line, so every call costs what it did before the math moved into the headers.
+		namespace OutOfLine
+		{
+			MATH_BENCHMARK_NOINLINE float Dot(const Vector3& v1, const Vector3& v2)
+			{
+				return v1.x * v2.x + v1.y * v2.y + v1.z * v2.z;
+			}
+
+			MATH_BENCHMARK_NOINLINE Vector3 Cross(const Vector3& v1, const Vector3& v2)
+			{
+				return { v1.y * v2.z - v1.z * v2.y, -(v1.x * v2.z - v1.z * v2.x), v1.x * v2.y - v1.y * v2.x };
+			}
+
+			MATH_BENCHMARK_NOINLINE Vector3 Normalized(const Vector3& v)
+			{
+				const float m = sqrtf(v.x * v.x + v.y * v.y + v.z * v.z);
+				return { v.x / m, v.y / m, v.z / m };
+			}
+
+			MATH_BENCHMARK_NOINLINE Vector3 TransformVector(const Matrix& m, const Vector3& v)
+			{
+				return Vector3{
+					m[0].x * v.x + m[1].x * v.y + m[2].x * v.z,
+					m[0].y * v.x + m[1].y * v.y + m[2].y * v.z,
+					m[0].z * v.x + m[1].z * v.y + m[2].z * v.z
+				};
+			}
+
+			MATH_BENCHMARK_NOINLINE Vector3 TransformPoint(const Matrix& m, const Vector3& p)
+			{
+				return Vector3{
+					m[0].x * p.x + m[1].x * p.y + m[2].x * p.z + m[3].x,
+					m[0].y * p.x + m[1].y * p.y + m[2].y * p.z + m[3].y,
+					m[0].z * p.x + m[1].z * p.y + m[2].z * p.z + m[3].z,
+				};
+			}
+
+			MATH_BENCHMARK_NOINLINE float Dot(const Vector4& v1, const Vector4& v2)
+			{
+				return v1.x * v2.x + v1.y * v2.y + v1.z * v2.z + v1.w * v2.w;
+			}
+
+			MATH_BENCHMARK_NOINLINE Matrix Multiply(const Matrix& m1, const Matrix& m2)
+			{
+				Matrix result{};
+				const Matrix m2Transposed{ Matrix::Transpose(m2) };
+
+				for (int r{ 0 }; r < 4; ++r)
+				{
+					for (int c{ 0 }; c < 4; ++c)
+					{
+						result[r][c] = Dot(m1[r], m2Transposed[c]);
+					}
+				}
+
+				return result;
+			}
+		}
+
+#if defined(_M_X64) || defined(__SSE2__)
+		//Vector3 and ColorRGB as they would be with SSE: every operation moves the 12 byte structs into a register and back,
+		//the intersection and shading code keeps them in plain structs and arrays. Same operation order as the scalar code.
+		namespace Packed
+		{
+			__m128 Load(float x, float y, float z) { return _mm_setr_ps(x, y, z, 0.f); }
+
+			Vector3 ToVector3(__m128 v)
+			{
+				alignas(16) float components[4];
+				_mm_store_ps(components, v);
+				return { components[0], components[1], components[2] };
+			}
+
+			float Sum(__m128 v)
+			{
+#if defined(__SSE4_1__) || defined(__AVX__)
+				return _mm_cvtss_f32(_mm_dp_ps(v, _mm_setr_ps(1.f, 1.f, 1.f, 0.f), 0x71));
+#else
+				return _mm_cvtss_f32(_mm_add_ss(_mm_add_ss(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1))), _mm_movehl_ps(v, v)));
+#endif
+			}
+
+			float Dot(const Vector3& v1, const Vector3& v2)
+			{
+				return Sum(_mm_mul_ps(Load(v1.x, v1.y, v1.z), Load(v2.x, v2.y, v2.z)));
+			}
+
+			Vector3 Cross(const Vector3& v1, const Vector3& v2)
+			{
+				const __m128 a{ Load(v1.x, v1.y, v1.z) };
+				const __m128 b{ Load(v2.x, v2.y, v2.z) };
+				const __m128 aYZX{ _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1)) };
+				const __m128 bYZX{ _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1)) };
+				const __m128 aZXY{ _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 1, 0, 2)) };
+				const __m128 bZXY{ _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 1, 0, 2)) };
+				return ToVector3(_mm_sub_ps(_mm_mul_ps(aYZX, bZXY), _mm_mul_ps(aZXY, bYZX)));
+			}
+
+			//irradiance * BRDF * cosineLaw, the product every light adds to a pixel
+			ColorRGB Shade(const ColorRGB& irradiance, const ColorRGB& BRDF, float cosineLaw)
+			{
+				const __m128 product{ _mm_mul_ps(_mm_mul_ps(Load(irradiance.r, irradiance.g, irradiance.b), Load(BRDF.r, BRDF.g, BRDF.b)), _mm_set1_ps(cosineLaw)) };
+				const Vector3 color{ ToVector3(product) };
+				return { color.x, color.y, color.z };
+			}
+		}
+#endif
+
+		struct MathBenchmarkResult
+		{
+			double outOfLineNanoseconds{};
+			double inlineNanoseconds{};
+			bool isIdentical{};
+		};
+
+		bool AreIdentical(float a, float b) { return std::memcmp(&a, &b, sizeof(float)) == 0; }
+		bool AreIdentical(const Vector3& a, const Vector3& b) { return AreIdentical(a.x, b.x) && AreIdentical(a.y, b.y) && AreIdentical(a.z, b.z); }
+		bool AreIdentical(const ColorRGB& a, const ColorRGB& b) { return AreIdentical(a.r, b.r) && AreIdentical(a.g, b.g) && AreIdentical(a.b, b.b); }
+		bool AreIdentical(const Matrix& a, const Matrix& b)
+		{
+			for (int r{ 0 }; r < 4; ++r)
+			{
+				for (int c{ 0 }; c < 4; ++c)
+				{
+					if (!AreIdentical(a[r][c], b[r][c]))
+						return false;
+				}
+			}
+			return true;
+		}
+
+		//Runs both versions over every input, repeatCount times, and reports the average time per call.
+		//Every result is stored, so the compiler can't drop the inlined calls.
+		template<typename OutOfLineFunc, typename InlineFunc>
+		MathBenchmarkResult Measure(int inputCount, int repeatCount, const OutOfLineFunc& outOfLineFunc, const InlineFunc& inlineFunc)
+		{
+			using ResultType = decltype(inlineFunc(0));
+			std::vector<ResultType> outOfLineResults(inputCount);
+			std::vector<ResultType> inlineResults(inputCount);
+
+			const auto measure = [&](const auto& func, std::vector<ResultType>& results)
+				{
+					const auto startTime{ std::chrono::steady_clock::now() };
+					for (int repeatIdx{}; repeatIdx < repeatCount; ++repeatIdx)
+					{
+						for (int inputIdx{}; inputIdx < inputCount; ++inputIdx)
+						{
+							results[inputIdx] = func(inputIdx);
+						}
+					}
+					const double nanoseconds{ std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - startTime).count() };
+					return nanoseconds / (static_cast<double>(repeatCount) * inputCount);
+				};
+
+			MathBenchmarkResult result{};
+			result.outOfLineNanoseconds = measure(outOfLineFunc, outOfLineResults);
+			result.inlineNanoseconds = measure(inlineFunc, inlineResults);
+
+			result.isIdentical = true;
+			for (int inputIdx{}; inputIdx < inputCount; ++inputIdx)
+			{
+				result.isIdentical = result.isIdentical && AreIdentical(outOfLineResults[inputIdx], inlineResults[inputIdx]);
+			}
+			return result;
+		}
+
+		void PrintResult(const char* name, const MathBenchmarkResult& result)
+		{
+			std::cout << std::left << std::setw(18) << name << std::right << std::fixed << std::setprecision(2)
+				<< std::setw(12) << result.outOfLineNanoseconds
+				<< std::setw(12) << result.inlineNanoseconds
+				<< std::setw(10) << result.outOfLineNanoseconds / result.inlineNanoseconds << "x"
+				<< (result.isIdentical ? "   identical" : "   MISMATCH") << std::endl;
+		}
+	}
+
+	bool RunMathBenchmark(int repeatCount)
+	{
+		constexpr int inputCount{ 4096 };
+
+		//Fixed seed, every run times the same inputs
+		std::mt19937 generator{ 2023 };
+		std::uniform_real_distribution<float> distribution{ -10.f, 10.f };
+
+		std::vector<Vector3> vectorsA(inputCount);
+		std::vector<Vector3> vectorsB(inputCount);
+		std::vector<Matrix> matrices(inputCount);
+		for (int inputIdx{}; inputIdx < inputCount; ++inputIdx)
+		{
+			vectorsA[inputIdx] = { distribution(generator), distribution(generator), distribution(generator) };
+			vectorsB[inputIdx] = { distribution(generator), distribution(generator), distribution(generator) };
+			matrices[inputIdx] = Matrix::CreateScale(vectorsB[inputIdx]) * Matrix::CreateRotationY(distribution(generator)) * Matrix::CreateTranslation(vectorsA[inputIdx]);
+		}
+		const Matrix& transform{ matrices[0] };
+
+		std::cout << std::left << std::setw(18) << "operation" << std::right << std::setw(12) << "old ns/op" << std::setw(12) << "new ns/op" << std::setw(11) << "speedup" << std::endl;
+
+		const MathBenchmarkResult results[]
+		{
+			Measure(inputCount, repeatCount,
+				[&](int idx) { return OutOfLine::Dot(vectorsA[idx], vectorsB[idx]); },
+				[&](int idx) { return Vector3::Dot(vectorsA[idx], vectorsB[idx]); }),
+			Measure(inputCount, repeatCount,
+				[&](int idx) { return OutOfLine::Cross(vectorsA[idx], vectorsB[idx]); },
+				[&](int idx) { return Vector3::Cross(vectorsA[idx], vectorsB[idx]); }),
+			Measure(inputCount, repeatCount,
+				[&](int idx) { return OutOfLine::Normalized(vectorsA[idx]); },
+				[&](int idx) { return vectorsA[idx].Normalized(); }),
+			Measure(inputCount, repeatCount,
+				[&](int idx) { return OutOfLine::TransformVector(transform, vectorsA[idx]); },
+				[&](int idx) { return transform.TransformVector(vectorsA[idx]); }),
+			Measure(inputCount, repeatCount,
+				[&](int idx) { return OutOfLine::TransformPoint(transform, vectorsA[idx]); },
+				[&](int idx) { return transform.TransformPoint(vectorsA[idx]); }),
+			Measure(inputCount, repeatCount / 8,
+				[&](int idx) { return OutOfLine::Multiply(matrices[idx], transform); },
+				[&](int idx) { return matrices[idx] * transform; })
+		};
+		const char* names[]{ "Vector3::Dot", "Vector3::Cross", "Normalized", "TransformVector", "TransformPoint", "Matrix multiply" };
+
+		bool isIdentical{ true };
+		for (int resultIdx{}; resultIdx < static_cast<int>(std::size(results)); ++resultIdx)
+		{
+			PrintResult(names[resultIdx], results[resultIdx]);
+			isIdentical = isIdentical && results[resultIdx].isIdentical;
+		}
+
+#if defined(_M_X64) || defined(__SSE2__)
+		//Why Vector3 and ColorRGB stay scalar apart from the divides: the same operations with the structs packed into SSE registers
+		std::vector<ColorRGB> colorsA(inputCount);
+		std::vector<ColorRGB> colorsB(inputCount);
+		for (int inputIdx{}; inputIdx < inputCount; ++inputIdx)
+		{
+			colorsA[inputIdx] = { vectorsA[inputIdx].x, vectorsA[inputIdx].y, vectorsA[inputIdx].z };
+			colorsB[inputIdx] = { vectorsB[inputIdx].x, vectorsB[inputIdx].y, vectorsB[inputIdx].z };
+		}
+
+		std::cout << std::endl << std::left << std::setw(18) << "operation" << std::right << std::setw(12) << "scalar ns/op" << std::setw(12) << "SSE ns/op" << std::setw(11) << "speedup" << std::endl;
+
+		const MathBenchmarkResult packedResults[]
+		{
+			Measure(inputCount, repeatCount,
+				[&](int idx) { return Vector3::Dot(vectorsA[idx], vectorsB[idx]); },
+				[&](int idx) { return Packed::Dot(vectorsA[idx], vectorsB[idx]); }),
+			Measure(inputCount, repeatCount,
+				[&](int idx) { return Vector3::Cross(vectorsA[idx], vectorsB[idx]); },
+				[&](int idx) { return Packed::Cross(vectorsA[idx], vectorsB[idx]); }),
+			Measure(inputCount, repeatCount,
+				[&](int idx) { const ColorRGB& irradiance{ colorsA[idx] }; return irradiance * colorsB[idx] * vectorsA[idx].x; },
+				[&](int idx) { return Packed::Shade(colorsA[idx], colorsB[idx], vectorsA[idx].x); })
+		};
+		const char* packedNames[]{ "Vector3::Dot", "Vector3::Cross", "ColorRGB shade" };
+
+		for (int resultIdx{}; resultIdx < static_cast<int>(std::size(packedResults)); ++resultIdx)
+		{
+			PrintResult(packedNames[resultIdx], packedResults[resultIdx]);
+			isIdentical = isIdentical && packedResults[resultIdx].isIdentical;
+		}
+#endif
+		return isIdentical;
+	}
+}
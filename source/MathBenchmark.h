@@ -0,0 +1,9 @@
+#pragma once
+
+namespace dae
+{
+	//Times the inline math in Vector3, Vector4 and Matrix against copies of the old out of line versions,
+	//and the scalar Vector3 and ColorRGB operations against packed SSE versions of them.
+	//Checks that both sides give bit identical results. Returns false on a mismatch.
+	bool RunMathBenchmark(int repeatCount = 2000);
+}
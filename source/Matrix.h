@@ -1,4 +1,8 @@
 #pragma once
+#include <cassert>
+#include <cmath>
+
+#include "MathHelpers.h"
 #include "Vector3.h"
 #include "Vector4.h"
 
@@ -25,6 +29,7 @@ namespace dae {
 		Vector3 TransformPoint(const Vector3& p) const;
 		Vector3 TransformPoint(float x, float y, float z) const;
 		const Matrix& Transpose();
+		const Matrix& Inverse();
 
 		Vector3 GetAxisX() const;
 		Vector3 GetAxisY() const;
@@ -41,6 +46,7 @@ namespace dae {
 		static Matrix CreateScale(float sx, float sy, float sz);
 		static Matrix CreateScale(const Vector3& s);
 		static Matrix Transpose(const Matrix& m);
+		static Matrix Inverse(const Matrix& m);
 
 		Vector4& operator[](int index);
 		Vector4 operator[](int index) const;
@@ -62,5 +68,301 @@ namespace dae {
 		// v1x v1y v1z v1w
 		// v2x v2y v2z v2w
 		// v3x v3y v3z v3w
+
+#if defined(_M_X64) || defined(__SSE2__)
+		static Vector3 ToVector3(__m128 v)
+		{
+			alignas(16) float components[4];
+			_mm_store_ps(components, v);
+			return { components[0], components[1], components[2] };
+		}
+#endif
 	};
-}
\ No newline at end of file
+
+	inline Matrix::Matrix(const Vector3& xAxis, const Vector3& yAxis, const Vector3& zAxis, const Vector3& t) :
+		Matrix({ xAxis, 0 }, { yAxis, 0 }, { zAxis, 0 }, { t, 1 })
+	{
+	}
+
+	inline Matrix::Matrix(const Vector4& xAxis, const Vector4& yAxis, const Vector4& zAxis, const Vector4& t)
+	{
+		data[0] = xAxis;
+		data[1] = yAxis;
+		data[2] = zAxis;
+		data[3] = t;
+	}
+
+	inline Matrix::Matrix(const Matrix& m)
+	{
+		data[0] = m[0];
+		data[1] = m[1];
+		data[2] = m[2];
+		data[3] = m[3];
+	}
+
+	inline Vector3 Matrix::TransformVector(const Vector3& v) const
+	{
+		return TransformVector(v[0], v[1], v[2]);
+	}
+
+	inline Vector3 Matrix::TransformVector(float x, float y, float z) const
+	{
+#if defined(_M_X64) || defined(__SSE2__)
+		//Same multiplies and additions in the same order as the scalar rows, only for all three components at once
+		const __m128 result{ _mm_add_ps(_mm_add_ps(
+			_mm_mul_ps(data[0].Load(), _mm_set1_ps(x)),
+			_mm_mul_ps(data[1].Load(), _mm_set1_ps(y))),
+			_mm_mul_ps(data[2].Load(), _mm_set1_ps(z))) };
+		return ToVector3(result);
+#else
+		return Vector3{
+			data[0].x * x + data[1].x * y + data[2].x * z,
+			data[0].y * x + data[1].y * y + data[2].y * z,
+			data[0].z * x + data[1].z * y + data[2].z * z
+		};
+#endif
+	}
+
+	inline Vector3 Matrix::TransformPoint(const Vector3& p) const
+	{
+		return TransformPoint(p[0], p[1], p[2]);
+	}
+
+	inline Vector3 Matrix::TransformPoint(float x, float y, float z) const
+	{
+#if defined(_M_X64) || defined(__SSE2__)
+		const __m128 result{ _mm_add_ps(_mm_add_ps(_mm_add_ps(
+			_mm_mul_ps(data[0].Load(), _mm_set1_ps(x)),
+			_mm_mul_ps(data[1].Load(), _mm_set1_ps(y))),
+			_mm_mul_ps(data[2].Load(), _mm_set1_ps(z))),
+			data[3].Load()) };
+		return ToVector3(result);
+#else
+		return Vector3{
+			data[0].x * x + data[1].x * y + data[2].x * z + data[3].x,
+			data[0].y * x + data[1].y * y + data[2].y * z + data[3].y,
+			data[0].z * x + data[1].z * y + data[2].z * z + data[3].z,
+		};
+#endif
+	}
+
+	inline const Matrix& Matrix::Transpose()
+	{
+		Matrix result{};
+		for (int r{ 0 }; r < 4; ++r)
+		{
+			for (int c{ 0 }; c < 4; ++c)
+			{
+				result[r][c] = data[c][r];
+			}
+		}
+
+		data[0] = result[0];
+		data[1] = result[1];
+		data[2] = result[2];
+		data[3] = result[3];
+
+		return *this;
+	}
+
+	inline Matrix Matrix::Transpose(const Matrix& m)
+	{
+		Matrix out{ m };
+		out.Transpose();
+
+		return out;
+	}
+
+	//Affine inverse: inverts the 3x3 part and moves the translation back through it
+	inline const Matrix& Matrix::Inverse()
+	{
+		const Vector3 a{ data[0] };
+		const Vector3 b{ data[1] };
+		const Vector3 c{ data[2] };
+
+		const Vector3 r0{ Vector3::Cross(b, c) };
+		const Vector3 r1{ Vector3::Cross(c, a) };
+		const Vector3 r2{ Vector3::Cross(a, b) };
+
+		const float determinant{ Vector3::Dot(a, r0) };
+		assert(determinant != 0.f && "Matrix is not invertible");
+		const float invDeterminant{ 1.f / determinant };
+
+		//The adjugate has the cross products as columns
+		data[0] = { r0.x * invDeterminant, r1.x * invDeterminant, r2.x * invDeterminant, 0 };
+		data[1] = { r0.y * invDeterminant, r1.y * invDeterminant, r2.y * invDeterminant, 0 };
+		data[2] = { r0.z * invDeterminant, r1.z * invDeterminant, r2.z * invDeterminant, 0 };
+
+		const Vector3 t{ TransformVector(Vector3{ data[3] }) };
+		data[3] = { -t.x, -t.y, -t.z, 1 };
+
+		return *this;
+	}
+
+	inline Matrix Matrix::Inverse(const Matrix& m)
+	{
+		Matrix out{ m };
+		out.Inverse();
+
+		return out;
+	}
+
+	inline Vector3 Matrix::GetAxisX() const
+	{
+		return data[0];
+	}
+
+	inline Vector3 Matrix::GetAxisY() const
+	{
+		return data[1];
+	}
+
+	inline Vector3 Matrix::GetAxisZ() const
+	{
+		return data[2];
+	}
+
+	inline Vector3 Matrix::GetTranslation() const
+	{
+		return data[3];
+	}
+
+	inline Matrix Matrix::CreateTranslation(float x, float y, float z)
+	{
+		//todo W1
+		//assert(false && "Not Implemented Yet");
+		Matrix returnMatrix{};
+		returnMatrix.data[0] = Vector4{ 1,0,0,0 };
+		returnMatrix.data[1] = Vector4{ 0,1,0,0 };
+		returnMatrix.data[2] = Vector4{ 0,0,1,0 };
+		returnMatrix.data[3] = Vector4{	   x,	y,	 z,1 };
+		return returnMatrix;
+	}
+
+	inline Matrix Matrix::CreateTranslation(const Vector3& t)
+	{
+		return { Vector3::UnitX, Vector3::UnitY, Vector3::UnitZ, t };
+	}
+
+	inline Matrix Matrix::CreateRotationX(float pitch)
+	{
+		//todo W1
+		//assert(false && "Not Implemented Yet");
+		Matrix returnMatrix{};
+		returnMatrix.data[0] = Vector4{ 1,0,0,0 };
+		returnMatrix.data[1] = Vector4{ 0,cosf(pitch * TO_RADIANS),-sinf(pitch * TO_RADIANS),0};
+		returnMatrix.data[2] = Vector4{ 0,sinf(pitch * TO_RADIANS),cosf(pitch * TO_RADIANS),0};
+		returnMatrix.data[3] = Vector4{ 0,0,0,1 };
+		return returnMatrix;
+	}
+
+	inline Matrix Matrix::CreateRotationY(float yaw)
+	{
+		//todo W1
+		//assert(false && "Not Implemented Yet");
+		Matrix returnMatrix{};
+		returnMatrix.data[0] = Vector4{ cosf(yaw),0,-sinf(yaw),0};
+		returnMatrix.data[1] = Vector4{ 0,1,0,0 };
+		returnMatrix.data[2] = Vector4{ sinf(yaw),0,cosf(yaw),0};
+		returnMatrix.data[3] = Vector4{ 0,0,0,1 };
+		return returnMatrix;
+	}
+
+	inline Matrix Matrix::CreateRotationZ(float roll)
+	{
+		//todo W1
+		//assert(false && "Not Implemented Yet");
+		Matrix returnMatrix{};
+		returnMatrix.data[0] = Vector4{ cosf(roll * TO_RADIANS),sinf(roll * TO_RADIANS),0,0};
+		returnMatrix.data[1] = Vector4{ -sinf(roll * TO_RADIANS),cosf(roll * TO_RADIANS),0,0};
+		returnMatrix.data[2] = Vector4{ 0,0,1,0 };
+		returnMatrix.data[3] = Vector4{ 0,0,0,1 };
+		return returnMatrix;
+	}
+
+	inline Matrix Matrix::CreateRotation(const Vector3& r)
+	{
+		//todo W1
+		//assert(false && "Not Implemented Yet");
+		Matrix returnMatrix{};
+		returnMatrix = CreateRotationX(r.x) * CreateRotationY(r.y) * CreateRotationZ(r.z);
+		return returnMatrix;
+	}
+
+	inline Matrix Matrix::CreateRotation(float pitch, float yaw, float roll)
+	{
+		return CreateRotation({ pitch, yaw, roll });
+	}
+
+	inline Matrix Matrix::CreateScale(float sx, float sy, float sz)
+	{
+		//todo W1
+		//assert(false && "Not Implemented Yet");
+		Matrix returnMatrix{};
+		returnMatrix.data[0] = Vector4{ sx,0,0,0 };
+		returnMatrix.data[1] = Vector4{ 0,sy,0,0 };
+		returnMatrix.data[2] = Vector4{ 0,0,sz,0 };
+		returnMatrix.data[3] = Vector4{ 0,0,0,1 };
+		return returnMatrix;
+	}
+
+	inline Matrix Matrix::CreateScale(const Vector3& s)
+	{
+		return CreateScale(s[0], s[1], s[2]);
+	}
+
+#pragma region Operator Overloads
+	inline Vector4& Matrix::operator[](int index)
+	{
+		assert(index <= 3 && index >= 0);
+		return data[index];
+	}
+
+	inline Vector4 Matrix::operator[](int index) const
+	{
+		assert(index <= 3 && index >= 0);
+		return data[index];
+	}
+
+	inline Matrix Matrix::operator*(const Matrix& m) const
+	{
+		Matrix result{ *this };
+		result *= m;
+		return result;
+	}
+
+	inline const Matrix& Matrix::operator*=(const Matrix& m)
+	{
+#if defined(_M_X64) || defined(__SSE2__)
+		//Row r of the product is the rows of m weighted by the elements of row r, summed in the order Vector4::Dot uses
+		const __m128 m0{ m.data[0].Load() };
+		const __m128 m1{ m.data[1].Load() };
+		const __m128 m2{ m.data[2].Load() };
+		const __m128 m3{ m.data[3].Load() };
+
+		for (int r{ 0 }; r < 4; ++r)
+		{
+			const Vector4 row{ data[r] };
+			data[r].Store(_mm_add_ps(_mm_add_ps(_mm_add_ps(
+				_mm_mul_ps(_mm_set1_ps(row.x), m0),
+				_mm_mul_ps(_mm_set1_ps(row.y), m1)),
+				_mm_mul_ps(_mm_set1_ps(row.z), m2)),
+				_mm_mul_ps(_mm_set1_ps(row.w), m3)));
+		}
+#else
+		Matrix copy{ *this };
+		Matrix m_transposed = Transpose(m);
+
+		for (int r{ 0 }; r < 4; ++r)
+		{
+			for (int c{ 0 }; c < 4; ++c)
+			{
+				data[r][c] = Vector4::Dot(copy[r], m_transposed[c]);
+			}
+		}
+#endif
+
+		return *this;
+	}
+#pragma endregion
+}
@@ -0,0 +1,174 @@
+#include "MeshCache.h"
+
+//Standard includes
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <type_traits>
+#include <vector>
+
+//Project includes
+#include "DataTypes.h"
+#include "MappedFile.h"
+#include "Utils.h"
+
+namespace dae
+{
+	namespace
+	{
+		//Bump whenever the layout or the way the cached data is calculated changes
+		constexpr uint32_t MeshCacheVersion{ 2 };
+		constexpr char MeshCacheMagic[4]{ 'D', 'A', 'E', 'M' };
+
+		//The arrays follow the header in this order: positions, normals, indices, BVH nodes and BVH primitive indices
+		struct MeshCacheHeader
+		{
+			char magic[4]{};
+			uint32_t version{};
+			uint32_t leafBlockSize{};
+			uint32_t positionCount{};
+			uint32_t normalCount{};
+			uint32_t indexCount{};
+			uint32_t nodeCount{};
+			uint32_t primitiveIndexCount{};
+
+			uint64_t sourceSize{};
+			uint64_t sourceChecksum{};
+			uint64_t dataChecksum{}; //over everything behind the header
+		};
+
+		//The arrays are stored as their raw bytes
+		static_assert(std::is_trivially_copyable_v<Vector3>);
+		static_assert(std::is_trivially_copyable_v<BVHNode>);
+
+		//FNV-1a over 8 byte words instead of single bytes, so checking a big OBJ on every load stays cheap
+		uint64_t CalculateChecksum(const char* pData, size_t size)
+		{
+			constexpr uint64_t Prime{ 0x100000001b3ull };
+			uint64_t checksum{ 0xcbf29ce484222325ull };
+
+			size_t offset{};
+			for (; offset + sizeof(uint64_t) <= size; offset += sizeof(uint64_t))
+			{
+				uint64_t word{};
+				std::memcpy(&word, pData + offset, sizeof(uint64_t));
+				checksum = (checksum ^ word) * Prime;
+				checksum ^= checksum >> 32; //the multiply only carries upwards, fold the high bits back down
+			}
+
+			for (; offset < size; ++offset)
+			{
+				checksum = (checksum ^ static_cast<uint8_t>(pData[offset])) * Prime;
+			}
+			return checksum;
+		}
+
+		template<typename T>
+		void ReadArray(const char*& pData, uint32_t count, std::vector<T>& values)
+		{
+			values.resize(count);
+			if (count > 0)
+				std::memcpy(values.data(), pData, count * sizeof(T));
+			pData += count * sizeof(T);
+		}
+
+		template<typename T>
+		void WriteArray(std::vector<char>& data, const std::vector<T>& values)
+		{
+			const char* pBytes{ reinterpret_cast<const char*>(values.data()) };
+			data.insert(data.end(), pBytes, pBytes + values.size() * sizeof(T));
+		}
+
+		bool ReadMeshCache(const std::string& cacheFilename, uint64_t sourceSize, uint64_t sourceChecksum, TriangleMesh& mesh)
+		{
+			const MappedFile file{ cacheFilename };
+			if (!file.IsValid() || file.GetSize() < sizeof(MeshCacheHeader))
+				return false;
+
+			MeshCacheHeader header{};
+			std::memcpy(&header, file.GetData(), sizeof(MeshCacheHeader));
+			if (std::memcmp(header.magic, MeshCacheMagic, sizeof(MeshCacheMagic)) != 0 || header.version != MeshCacheVersion
+				|| header.leafBlockSize != TriangleSoA::Width || header.sourceSize != sourceSize || header.sourceChecksum != sourceChecksum)
+				return false;
+
+			//A cache that was cut off or damaged is treated like a stale one
+			const size_t dataSize{ (size_t{ header.positionCount } + header.normalCount) * sizeof(Vector3)
+				+ (size_t{ header.indexCount } + header.primitiveIndexCount) * sizeof(int) + size_t{ header.nodeCount } * sizeof(BVHNode) };
+			const char* pData{ file.GetData() + sizeof(MeshCacheHeader) };
+			if (file.GetSize() != sizeof(MeshCacheHeader) + dataSize || CalculateChecksum(pData, dataSize) != header.dataChecksum)
+				return false;
+
+			ReadArray(pData, header.positionCount, mesh.positions);
+			ReadArray(pData, header.normalCount, mesh.normals);
+			ReadArray(pData, header.indexCount, mesh.indices);
+
+			std::vector<BVHNode> nodes{};
+			std::vector<int> primitiveIndices{};
+			ReadArray(pData, header.nodeCount, nodes);
+			ReadArray(pData, header.primitiveIndexCount, primitiveIndices);
+			mesh.bvh.Assign(std::move(nodes), std::move(primitiveIndices), static_cast<int>(header.leafBlockSize));
+
+			return true;
+		}
+
+		bool WriteMeshCache(const std::string& cacheFilename, uint64_t sourceSize, uint64_t sourceChecksum, const TriangleMesh& mesh)
+		{
+			std::vector<char> data{};
+			WriteArray(data, mesh.positions);
+			WriteArray(data, mesh.normals);
+			WriteArray(data, mesh.indices);
+			WriteArray(data, mesh.bvh.GetNodes());
+			WriteArray(data, mesh.bvh.GetPrimitiveIndices());
+
+			MeshCacheHeader header{};
+			std::memcpy(header.magic, MeshCacheMagic, sizeof(MeshCacheMagic));
+			header.version = MeshCacheVersion;
+			header.leafBlockSize = static_cast<uint32_t>(mesh.bvh.GetLeafBlockSize());
+			header.positionCount = static_cast<uint32_t>(mesh.positions.size());
+			header.normalCount = static_cast<uint32_t>(mesh.normals.size());
+			header.indexCount = static_cast<uint32_t>(mesh.indices.size());
+			header.nodeCount = static_cast<uint32_t>(mesh.bvh.GetNodes().size());
+			header.primitiveIndexCount = static_cast<uint32_t>(mesh.bvh.GetPrimitiveIndices().size());
+			header.sourceSize = sourceSize;
+			header.sourceChecksum = sourceChecksum;
+			header.dataChecksum = CalculateChecksum(data.data(), data.size());
+
+			std::ofstream file{ cacheFilename, std::ios::binary };
+			if (!file)
+				return false;
+
+			file.write(reinterpret_cast<const char*>(&header), sizeof(MeshCacheHeader));
+			file.write(data.data(), static_cast<std::streamsize>(data.size()));
+			return static_cast<bool>(file);
+		}
+	}
+
+	bool LoadCachedOBJ(const std::string& filename, TriangleMesh& mesh)
+	{
+		uint64_t sourceSize{};
+		uint64_t sourceChecksum{};
+		{
+			const MappedFile source{ filename };
+			if (!source.IsValid())
+				return false;
+
+			sourceSize = source.GetSize();
+			sourceChecksum = CalculateChecksum(source.GetData(), source.GetSize());
+		}
+
+		const std::string cacheFilename{ filename + ".meshcache" };
+		if (ReadMeshCache(cacheFilename, sourceSize, sourceChecksum, mesh))
+			return true;
+
+		if (!Utils::ParseOBJ(filename, mesh.positions, mesh.normals, mesh.indices))
+			return false;
+
+		//The cached tree is built over the untransformed triangles, placing the mesh afterwards only refits it
+		mesh.CalculateTriangleBounds(mesh.positions);
+		mesh.BuildBVH();
+
+		//Read only resource folders just mean the OBJ gets parsed again next time
+		WriteMeshCache(cacheFilename, sourceSize, sourceChecksum, mesh);
+		return true;
+	}
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+//Standard includes
+#include <string>
+
+namespace dae
+{
+	struct TriangleMesh;
+
+	/**
+	 * \brief Loads the positions, indices and face normals of an OBJ file, together with a BVH over the untransformed triangles
+	 * The first load parses the OBJ and writes everything to a binary cache next to it (filename + ".meshcache"), later loads copy
+	 * the arrays straight out of the mapped cache. The cache is only used while its version, the triangle block size it was built
+	 * for and the size and checksum of the OBJ it was made from still match, otherwise it is rewritten.
+	 * \return false when the OBJ can't be read, not being able to write the cache is not an error
+	 */
+	bool LoadCachedOBJ(const std::string& filename, TriangleMesh& mesh);
+}
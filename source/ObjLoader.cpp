@@ -0,0 +1,399 @@
+#include "ObjLoader.h"
+
+//Standard includes
+#include <algorithm>
+#include <charconv>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+
+//Project includes
+#include "MappedFile.h"
+
+namespace dae
+{
+	namespace
+	{
+		//Files below this size are parsed on the calling thread only, the thread start up would cost more than it saves
+		constexpr size_t MinChunkSize{ 4 * 1024 * 1024 };
+
+		//The float fast path only takes mantissas and powers of ten that are exact in a double, so the one division
+		//rounds correctly. With at most 12 fractional digits, rounding that double to float can't round twice either.
+		constexpr int MaxFastDigits{ 15 };
+		constexpr int MaxFastExponent{ 12 };
+		constexpr double PowersOf10[MaxFastExponent + 1]{ 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12 };
+
+		struct ObjCounts
+		{
+			size_t positions{};
+			size_t texCoords{}; //vt and vn are only counted, face corners are checked against them
+			size_t normals{};
+			size_t triangles{};
+		};
+
+		//Range of whole lines that is counted and parsed independently of the other chunks
+		struct ObjChunk
+		{
+			const char* pBegin{};
+			const char* pEnd{};
+
+			ObjCounts counts{};  //elements in this chunk, filled by the counting pass
+			ObjCounts offsets{}; //elements in all chunks before this one, where this chunk writes into the arrays
+			bool isValid{ true };
+		};
+
+		enum class ObjStatement
+		{
+			Other,
+			Position,
+			TexCoord,
+			Normal,
+			Face
+		};
+
+		bool IsSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+		bool IsDigit(char c) { return static_cast<unsigned char>(c - '0') < 10; }
+		bool IsEndOfStatement(const char* p, const char* pEnd) { return p == pEnd || *p == '\n' || *p == '#'; }
+		bool IsEndOfToken(const char* p, const char* pEnd) { return IsEndOfStatement(p, pEnd) || IsSpace(*p); }
+
+		void SkipSpaces(const char*& p, const char* pEnd)
+		{
+			while (p < pEnd && IsSpace(*p))
+				++p;
+		}
+
+		//Moves to the start of the next line
+		void SkipLine(const char*& p, const char* pEnd)
+		{
+			const void* pNewLine{ std::memchr(p, '\n', pEnd - p) };
+			p = pNewLine ? static_cast<const char*>(pNewLine) + 1 : pEnd;
+		}
+
+		//Reads the keyword at the start of a line and leaves p right behind it
+		ObjStatement ReadStatement(const char*& p, const char* pEnd)
+		{
+			SkipSpaces(p, pEnd);
+			const char* pKeyword{ p };
+			while (!IsEndOfToken(p, pEnd))
+				++p;
+
+			const auto length{ p - pKeyword };
+			if (length == 1 && pKeyword[0] == 'v')
+				return ObjStatement::Position;
+			if (length == 1 && pKeyword[0] == 'f')
+				return ObjStatement::Face;
+			if (length == 2 && pKeyword[0] == 'v' && pKeyword[1] == 't')
+				return ObjStatement::TexCoord;
+			if (length == 2 && pKeyword[0] == 'v' && pKeyword[1] == 'n')
+				return ObjStatement::Normal;
+			return ObjStatement::Other;
+		}
+
+		//Plain decimals, which is what exporters write, are parsed by hand. Exponents, inf/nan and long mantissas go through std::from_chars.
+		bool ParseFloat(const char*& p, const char* pEnd, float& value)
+		{
+			SkipSpaces(p, pEnd);
+
+			bool isNegative{};
+			if (p < pEnd && (*p == '-' || *p == '+'))
+			{
+				isNegative = *p == '-';
+				++p;
+			}
+			const char* pNumber{ p };
+
+			uint64_t mantissa{};
+			int digitCount{}; //leading zeros don't count
+			int exponent{};
+			bool hasDigits{};
+			bool isFastPath{ true };
+
+			const auto addDigit = [&](char digit)
+			{
+				hasDigits = true;
+				if (digitCount == MaxFastDigits)
+				{
+					isFastPath = false;
+					return;
+				}
+
+				mantissa = mantissa * 10 + static_cast<uint64_t>(digit - '0');
+				if (mantissa != 0)
+					++digitCount;
+			};
+
+			for (; p < pEnd && IsDigit(*p); ++p)
+			{
+				addDigit(*p);
+			}
+
+			if (p < pEnd && *p == '.')
+			{
+				for (++p; p < pEnd && IsDigit(*p); ++p)
+				{
+					addDigit(*p);
+					--exponent;
+				}
+			}
+
+			if (!hasDigits || exponent < -MaxFastExponent || (p < pEnd && (*p == 'e' || *p == 'E')))
+				isFastPath = false;
+
+			if (isFastPath)
+			{
+				value = static_cast<float>(static_cast<double>(mantissa) / PowersOf10[-exponent]);
+			}
+			else
+			{
+				const auto [pNext, error] { std::from_chars(pNumber, pEnd, value) };
+				if (error != std::errc{})
+					return false;
+				p = pNext;
+			}
+
+			if (isNegative)
+				value = -value;
+			return IsEndOfToken(p, pEnd);
+		}
+
+		bool ParseInt(const char*& p, const char* pEnd, int& value)
+		{
+			bool isNegative{};
+			if (p < pEnd && (*p == '-' || *p == '+'))
+			{
+				isNegative = *p == '-';
+				++p;
+			}
+
+			if (p == pEnd || !IsDigit(*p))
+				return false;
+
+			int64_t result{};
+			for (; p < pEnd && IsDigit(*p); ++p)
+			{
+				result = result * 10 + (*p - '0');
+				if (result > INT_MAX)
+					return false;
+			}
+
+			value = static_cast<int>(isNegative ? -result : result);
+			return true;
+		}
+
+		//OBJ indices start at 1, negative ones count back from the last element read before the face
+		bool ResolveIndex(int index, size_t readCount, size_t totalCount, int& resolved)
+		{
+			const int64_t result{ index > 0 ? int64_t{ index } - 1 : static_cast<int64_t>(readCount) + index };
+			if (index == 0 || result < 0 || result >= static_cast<int64_t>(totalCount))
+				return false;
+
+			resolved = static_cast<int>(result);
+			return true;
+		}
+
+		//v, v/vt, v//vn or v/vt/vn. Only the position index is kept, the others are still checked to be in range.
+		bool ParseCorner(const char*& p, const char* pEnd, const ObjCounts& readCounts, const ObjCounts& totalCounts, int& position)
+		{
+			int index{};
+			if (!ParseInt(p, pEnd, index) || !ResolveIndex(index, readCounts.positions, totalCounts.positions, position))
+				return false;
+
+			int unused{};
+			if (p < pEnd && *p == '/')
+			{
+				++p;
+				if (p < pEnd && *p != '/')
+				{
+					if (!ParseInt(p, pEnd, index) || !ResolveIndex(index, readCounts.texCoords, totalCounts.texCoords, unused))
+						return false;
+				}
+
+				if (p < pEnd && *p == '/')
+				{
+					++p;
+					if (!ParseInt(p, pEnd, index) || !ResolveIndex(index, readCounts.normals, totalCounts.normals, unused))
+						return false;
+				}
+			}
+			return IsEndOfToken(p, pEnd);
+		}
+
+		//Polygons are triangulated as a fan around their first corner, which keeps the winding
+		bool ParseFace(const char*& p, const char* pEnd, const ObjCounts& readCounts, const ObjCounts& totalCounts, size_t& triangleIdx, ObjData& data)
+		{
+			int firstCorner{};
+			int previousCorner{};
+			int corner{};
+
+			for (int cornerIdx{};; ++cornerIdx)
+			{
+				SkipSpaces(p, pEnd);
+				if (IsEndOfStatement(p, pEnd))
+					return true;
+
+				if (!ParseCorner(p, pEnd, readCounts, totalCounts, corner))
+					return false;
+
+				if (cornerIdx == 0)
+				{
+					firstCorner = corner;
+				}
+				else if (cornerIdx >= 2)
+				{
+					const size_t firstCornerIdx{ 3 * triangleIdx++ };
+					data.indices[firstCornerIdx] = firstCorner;
+					data.indices[firstCornerIdx + 1] = previousCorner;
+					data.indices[firstCornerIdx + 2] = corner;
+				}
+				previousCorner = corner;
+			}
+		}
+
+		void CountChunk(ObjChunk& chunk)
+		{
+			const char* p{ chunk.pBegin };
+			while (p < chunk.pEnd)
+			{
+				switch (ReadStatement(p, chunk.pEnd))
+				{
+				case ObjStatement::Position:
+					++chunk.counts.positions;
+					break;
+				case ObjStatement::TexCoord:
+					++chunk.counts.texCoords;
+					break;
+				case ObjStatement::Normal:
+					++chunk.counts.normals;
+					break;
+				case ObjStatement::Face:
+				{
+					int cornerCount{};
+					for (;;)
+					{
+						SkipSpaces(p, chunk.pEnd);
+						if (IsEndOfStatement(p, chunk.pEnd))
+							break;
+
+						++cornerCount;
+						while (!IsEndOfToken(p, chunk.pEnd))
+							++p;
+					}
+					chunk.counts.triangles += std::max(cornerCount - 2, 0);
+					break;
+				}
+				default:
+					break;
+				}
+
+				SkipLine(p, chunk.pEnd);
+			}
+		}
+
+		//Every chunk writes behind the elements of the chunks before it, so they can be parsed in any order
+		void ParseChunk(ObjChunk& chunk, const ObjCounts& totalCounts, ObjData& data)
+		{
+			ObjCounts readCounts{ chunk.offsets };
+
+			const char* p{ chunk.pBegin };
+			while (p < chunk.pEnd && chunk.isValid)
+			{
+				switch (ReadStatement(p, chunk.pEnd))
+				{
+				case ObjStatement::Position:
+				{
+					Vector3& position{ data.positions[readCounts.positions++] };
+					chunk.isValid = ParseFloat(p, chunk.pEnd, position.x) && ParseFloat(p, chunk.pEnd, position.y) && ParseFloat(p, chunk.pEnd, position.z);
+					break;
+				}
+				case ObjStatement::TexCoord:
+					++readCounts.texCoords;
+					break;
+				case ObjStatement::Normal:
+					++readCounts.normals;
+					break;
+				case ObjStatement::Face:
+					chunk.isValid = ParseFace(p, chunk.pEnd, readCounts, totalCounts, readCounts.triangles, data);
+					break;
+				default:
+					break;
+				}
+
+				SkipLine(p, chunk.pEnd);
+			}
+		}
+
+		//The calling thread handles the first chunk itself
+		template<typename Function>
+		void RunChunks(std::vector<ObjChunk>& chunks, const Function& function)
+		{
+			std::vector<std::thread> workers{};
+			workers.reserve(chunks.size() - 1);
+			for (size_t chunkIdx{ 1 }; chunkIdx < chunks.size(); ++chunkIdx)
+			{
+				workers.emplace_back([&function, &chunk = chunks[chunkIdx]] { function(chunk); });
+			}
+
+			function(chunks[0]);
+
+			for (std::thread& worker : workers)
+			{
+				worker.join();
+			}
+		}
+	}
+
+	bool LoadOBJ(const std::string& filename, ObjData& data, bool allowParallel)
+	{
+		const MappedFile file{ filename };
+		if (!file.IsValid())
+			return false;
+
+		const char* pBegin{ file.GetData() };
+		const char* pEnd{ pBegin + file.GetSize() };
+
+		int chunkCount{ 1 };
+		if (allowParallel)
+		{
+			const int hardwareThreads{ std::max(static_cast<int>(std::thread::hardware_concurrency()), 1) };
+			chunkCount = static_cast<int>(std::clamp(file.GetSize() / MinChunkSize, size_t{ 1 }, static_cast<size_t>(hardwareThreads)));
+		}
+
+		//Cut into roughly equal chunks, every cut is moved forward to the next line start
+		std::vector<ObjChunk> chunks(chunkCount);
+		const char* pChunkBegin{ pBegin };
+		for (int chunkIdx{}; chunkIdx < chunkCount; ++chunkIdx)
+		{
+			const char* pChunkEnd{ pEnd };
+			if (chunkIdx + 1 < chunkCount)
+			{
+				pChunkEnd = std::max(pBegin + file.GetSize() / chunkCount * (chunkIdx + 1), pChunkBegin);
+				SkipLine(pChunkEnd, pEnd);
+			}
+
+			chunks[chunkIdx].pBegin = pChunkBegin;
+			chunks[chunkIdx].pEnd = pChunkEnd;
+			pChunkBegin = pChunkEnd;
+		}
+
+		//First pass only counts, so every array is allocated exactly once and the chunks know where to write
+		RunChunks(chunks, [](ObjChunk& chunk) { CountChunk(chunk); });
+
+		ObjCounts totalCounts{};
+		for (ObjChunk& chunk : chunks)
+		{
+			chunk.offsets = totalCounts;
+			totalCounts.positions += chunk.counts.positions;
+			totalCounts.texCoords += chunk.counts.texCoords;
+			totalCounts.normals += chunk.counts.normals;
+			totalCounts.triangles += chunk.counts.triangles;
+		}
+
+		data.positions.resize(totalCounts.positions);
+		data.indices.resize(3 * totalCounts.triangles);
+
+		RunChunks(chunks, [&totalCounts, &data](ObjChunk& chunk) { ParseChunk(chunk, totalCounts, data); });
+
+		return std::all_of(chunks.begin(), chunks.end(), [](const ObjChunk& chunk) { return chunk.isValid; });
+	}
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+//Standard includes
+#include <string>
+#include <vector>
+
+//Project includes
+#include "Math.h"
+
+namespace dae
+{
+	//Everything the loader reads from an OBJ file, faces are triangulated as fans around their first corner
+	struct ObjData
+	{
+		std::vector<Vector3> positions{};
+		std::vector<int> indices{}; //three position indices per triangle
+	};
+
+	/**
+	 * \brief Reads the v and f statements of an OBJ file, everything else is skipped.
+	 * Nothing shades with texture coordinates or vertex normals yet: vt and vn statements are only counted,
+	 * and the vt/vn indices of face corners are checked against those counts but not stored.
+	 * \param filename path of the file, it is memory mapped instead of streamed
+	 * \param data receives the parsed arrays, they are sized once up front from a counting pass
+	 * \param allowParallel big files are split at line boundaries and the chunks are parsed on multiple threads
+	 * \return false when the file can't be opened or has malformed numbers or indices
+	 */
+	bool LoadOBJ(const std::string& filename, ObjData& data, bool allowParallel = true);
+}
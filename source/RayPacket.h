@@ -0,0 +1,65 @@
+#pragma once
+#include <cfloat>
+#include <cstdint>
+
+#include "Math.h"
+
+namespace dae
+{
+	//4x4 block of coherent rays in SoA layout, one row of the block fills one SSE register
+	struct RayPacket
+	{
+		static constexpr int Width{ 4 };
+		static constexpr int Size{ Width * Width };
+
+		alignas(16) float originX[Size]{};
+		alignas(16) float originY[Size]{};
+		alignas(16) float originZ[Size]{};
+		alignas(16) float directionX[Size]{};
+		alignas(16) float directionY[Size]{};
+		alignas(16) float directionZ[Size]{};
+		alignas(16) float invDirectionX[Size]{};
+		alignas(16) float invDirectionY[Size]{};
+		alignas(16) float invDirectionZ[Size]{};
+		alignas(16) float max[Size]{};
+
+		float min{ 0.0001f };
+		uint32_t activeMask{}; //lanes that carry a ray (blocks on the frame border can be partial)
+
+		void SetRay(int lane, const Vector3& origin, const Vector3& direction, float tMax = FLT_MAX)
+		{
+			originX[lane] = origin.x;
+			originY[lane] = origin.y;
+			originZ[lane] = origin.z;
+			directionX[lane] = direction.x;
+			directionY[lane] = direction.y;
+			directionZ[lane] = direction.z;
+			invDirectionX[lane] = 1.f / direction.x;
+			invDirectionY[lane] = 1.f / direction.y;
+			invDirectionZ[lane] = 1.f / direction.z;
+			max[lane] = tMax;
+			activeMask |= 1u << lane;
+		}
+
+		Vector3 GetOrigin(int lane) const { return { originX[lane], originY[lane], originZ[lane] }; }
+		Vector3 GetDirection(int lane) const { return { directionX[lane], directionY[lane], directionZ[lane] }; }
+
+		//Shared traversal only pays off when all rays agree on the direction octant
+		bool IsCoherent() const
+		{
+			int signs{ -1 };
+			for (int lane{}; lane < Size; ++lane)
+			{
+				if ((activeMask & (1u << lane)) == 0)
+					continue;
+
+				const int laneSigns{ (directionX[lane] < 0.f ? 1 : 0) | (directionY[lane] < 0.f ? 2 : 0) | (directionZ[lane] < 0.f ? 4 : 0) };
+				if (signs == -1)
+					signs = laneSigns;
+				else if (signs != laneSigns)
+					return false;
+			}
+			return true;
+		}
+	};
+}
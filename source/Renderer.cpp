@@ -9,6 +9,14 @@
 #include "Material.h"
 #include "Scene.h"
 #include "Utils.h"
+#include "TileScheduler.h"
+#include "AllocationCounter.h"
+
+//Standard includes
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <iostream>
 
 using namespace dae;
 
@@ -18,119 +26,816 @@ Renderer::Renderer(SDL_Window * pWindow) :
 {
 	//Initialize
 	SDL_GetWindowSize(pWindow, &m_Width, &m_Height);
+	InitializeBuffers();
+}
+
+Renderer::Renderer(int width, int height) :
+	m_pBuffer(SDL_CreateRGBSurface(0, width, height, 32, 0x00FF0000, 0x0000FF00, 0x000000FF, 0)),
+	m_OwnsBuffer(true),
+	m_Width(width),
+	m_Height(height)
+{
+	//Initialize
+	InitializeBuffers();
+}
+
+Renderer::~Renderer()
+{
+	delete m_pTileScheduler;
+
+	if (m_OwnsBuffer)
+		SDL_FreeSurface(m_pBuffer);
+}
+
+void Renderer::InitializeBuffers()
+{
+	if (!m_pBuffer)
+		return;
+
 	m_pBufferPixels = static_cast<uint32_t*>(m_pBuffer->pixels);
+
+	SetThreadCount(0);
+
+	m_PrimaryHits.resize(static_cast<size_t>(m_Width) * m_Height);
+	m_PrimaryDirections.resize(static_cast<size_t>(m_Width) * m_Height);
+	m_PixelColors.resize(static_cast<size_t>(m_Width) * m_Height);
+}
+
+void Renderer::SetThreadCount(int threadCount)
+{
+	delete m_pTileScheduler;
+	m_pTileScheduler = new TileScheduler(threadCount);
+	m_pTileScheduler->SetFrameSize(m_Width, m_Height);
+
+	m_ThreadRayStatistics.assign(m_pTileScheduler->GetThreadCount(), RayStatistics{});
+	m_ThreadSampleHistograms.assign(m_pTileScheduler->GetThreadCount(), std::vector<uint64_t>(m_MaxAdaptiveSamples + 1));
+	m_ThreadShadingBatches.assign(m_pTileScheduler->GetThreadCount(), ShadingBatch{});
+	m_ThreadOccluders.assign(m_pTileScheduler->GetThreadCount(), std::vector<Occluder>{});
+
+	//Sized for a full tile up front, so shading never has to grow them mid frame
+	constexpr size_t tilePixelCount{ TileScheduler::TileSize * TileScheduler::TileSize };
+	for (ShadingBatch& batch : m_ThreadShadingBatches)
+	{
+		batch.colors.reserve(tilePixelCount);
+		for (std::vector<ShadingSample>& samples : batch.samples)
+		{
+			samples.reserve(tilePixelCount);
+		}
+	}
+
+	m_pWarmScene = nullptr;
+}
+
+void Renderer::SetAdaptiveSampling(bool isEnabled, int maxSamples, float contrastThreshold)
+{
+	m_IsAdaptiveSampling = isEnabled;
+	m_MaxAdaptiveSamples = std::max(maxSamples, 1);
+	m_ContrastThreshold = contrastThreshold;
+
+	m_ThreadSampleHistograms.assign(m_pTileScheduler->GetThreadCount(), std::vector<uint64_t>(m_MaxAdaptiveSamples + 1));
+	m_pWarmScene = nullptr;
 }
 
-void Renderer::Render(Scene* pScene) const
+void Renderer::SetLightSampling(bool isEnabled, int samplesPerPixel)
 {
+	m_IsLightSampling = isEnabled;
+	m_LightSamplesPerPixel = std::max(samplesPerPixel, 1);
+	m_SampleCount = 0;
+}
+
+void Renderer::SetLightCulling(bool isEnabled, float threshold)
+{
+	m_IsLightCulling = isEnabled;
+	m_LightCullThreshold = std::max(threshold, 0.f);
+	m_SampleCount = 0;
+}
+
+std::vector<uint64_t> Renderer::GetSampleDistribution() const
+{
+	std::vector<uint64_t> distribution(m_MaxAdaptiveSamples + 1);
+	for (const std::vector<uint64_t>& histogram : m_ThreadSampleHistograms)
+	{
+		for (int sampleCount{ 1 }; sampleCount <= m_MaxAdaptiveSamples; ++sampleCount)
+		{
+			distribution[sampleCount] += histogram[sampleCount];
+		}
+	}
+	return distribution;
+}
+
+int Renderer::GetThreadCount() const
+{
+	return m_pTileScheduler->GetThreadCount();
+}
+
+RayStatistics Renderer::GetRayStatistics() const
+{
+	RayStatistics total{};
+	for (const RayStatistics& statistics : m_ThreadRayStatistics)
+	{
+		total.primaryRays += statistics.primaryRays;
+		total.shadowRays += statistics.shadowRays;
+		total.culledShadowRays += statistics.culledShadowRays;
+	}
+	return total;
+}
+
+void Renderer::Render(Scene* pScene)
+{
+#ifdef _DEBUG
+	const uint64_t allocationCount{ AllocationCounter::GetAllocationCount() };
+#endif
+
+	pScene->UpdateAccelerationStructure();
+
 	Camera& camera = pScene->GetCamera();
-	auto& materials = pScene->GetMaterials();
+	auto& materials = pScene->GetMaterialTable();
 	auto& lights = pScene->GetLights();
 
-	const float ar{ float(m_Width) / float(m_Height) };
-	const float fov{ tanf((camera.fovAngle*TO_RADIANS) / 2) };
+	m_RayGenerator.Update(m_Width, m_Height, camera.fovAngle);
 
 	const Matrix cameraToWorld = camera.CalculateCameraToWorld();
 
-	for (int px{}; px < m_Width; ++px)
-	{
-		const float rayX{ (((2 * (px + 0.5f)) / m_Width) - 1) * ar * fov };
+	UpdateAccumulation(camera, pScene->GetGeometryVersion());
 
-		for (int py{}; py < m_Height; ++py)
+	std::fill(m_ThreadRayStatistics.begin(), m_ThreadRayStatistics.end(), RayStatistics{});
+
+	//Every tile is traced and shaded by exactly one thread, so the buffer writes never overlap
+	m_pTileScheduler->Run([&](const Tile& tile, int threadIdx)
 		{
-			const float rayY{ (1 - ((2 * (py + 0.5f)) / m_Height )) * fov };
+			TracePrimaryHits(pScene, tile, camera.origin, cameraToWorld);
 
-			const Vector3 origin{ 0,0,0 };
-			const Vector3 rayDirection = cameraToWorld.TransformVector(rayX, rayY, 1).Normalized();
+			RayStatistics tileStatistics{};
+			tileStatistics.primaryRays = static_cast<uint64_t>(tile.endX - tile.startX) * (tile.endY - tile.startY);
 
-			const Ray viewRay{ camera.origin, rayDirection };
+			//The light loop only reads the cached hits, the primary ray is never traced again
+			std::vector<Occluder>& occluders{ m_ThreadOccluders[threadIdx] };
+			occluders.assign(lights.size(), Occluder{});
+			ShadeTile(pScene, tile, lights, materials, m_ThreadShadingBatches[threadIdx], occluders, tileStatistics);
 
-			//float gradient = px / static_cast<float>(m_Width);
-			//gradient += py / static_cast<float>(m_Width);
-			//gradient /= 2.0f;
+			m_ThreadRayStatistics[threadIdx].primaryRays += tileStatistics.primaryRays;
+			m_ThreadRayStatistics[threadIdx].shadowRays += tileStatistics.shadowRays;
+			m_ThreadRayStatistics[threadIdx].culledShadowRays += tileStatistics.culledShadowRays;
+		});
 
-			//ColorRGB finalColor{ rayDirection.x, rayDirection.y, rayDirection.z };
-			ColorRGB finalColor{};
+	//Refinement needs the center samples of neighbouring tiles, so it only starts once the whole frame is shaded
+	if (m_IsAdaptiveSampling && !m_IsProgressive)
+	{
+		for (std::vector<uint64_t>& histogram : m_ThreadSampleHistograms)
+		{
+			std::fill(histogram.begin(), histogram.end(), 0);
+		}
 
-			HitRecord closestHit{};
-			//
-			//Sphere testSphere{ Vector3{0.f, 0.f, 100.f}, 50.f, 0 };
-			//
-			//GeometryUtils::HitTest_Sphere(testSphere, viewRay, closestHit);
-			//
+		m_pTileScheduler->Run([&](const Tile& tile, int threadIdx)
+			{
+				RayStatistics tileStatistics{};
+				std::vector<uint64_t>& histogram{ m_ThreadSampleHistograms[threadIdx] };
+				std::vector<Occluder>& occluders{ m_ThreadOccluders[threadIdx] };
+				occluders.assign(lights.size(), Occluder{});
+
+				//The extra samples start from the lights of the center samples of the tile, the culled ones were counted with those
+				ShadingBatch& batch{ m_ThreadShadingBatches[threadIdx] };
+				GatherTileLights(pScene, tile, lights, batch, nullptr);
+
+				for (int py{ tile.startY }; py < tile.endY; ++py)
+				{
+					for (int px{ tile.startX }; px < tile.endX; ++px)
+					{
+						++histogram[RefinePixel(pScene, px, py, camera.origin, cameraToWorld, lights, batch, materials, occluders, tileStatistics)];
+					}
+				}
+
+				m_ThreadRayStatistics[threadIdx].primaryRays += tileStatistics.primaryRays;
+				m_ThreadRayStatistics[threadIdx].shadowRays += tileStatistics.shadowRays;
+			});
+	}
+
+#ifdef _DEBUG
+	//Once a scene has been rendered every buffer has its final size, later frames must not touch the heap
+	assert((m_pWarmScene != pScene || AllocationCounter::GetAllocationCount() == allocationCount) && "Steady state frame allocated heap memory");
+#endif
+	m_pWarmScene = pScene;
+
+	//@END
+	//Update SDL Surface
+	if (m_pWindow)
+		SDL_UpdateWindowSurface(m_pWindow);
+}
+
+void Renderer::UpdateAccumulation(const Camera& camera, uint32_t geometryVersion)
+{
+	if (!m_IsProgressive)
+	{
+		m_SampleCount = 0;
+		m_PixelOffsetX = 0.5f;
+		m_PixelOffsetY = 0.5f;
+		return;
+	}
 
-			if(px == 320 && py == 288)
+	//Anything that changes what a pixel sees throws away the samples gathered so far
+	const bool isUnchanged{ m_SampleCount > 0
+		&& camera.origin.x == m_AccumulatedCameraOrigin.x && camera.origin.y == m_AccumulatedCameraOrigin.y && camera.origin.z == m_AccumulatedCameraOrigin.z
+		&& camera.forward.x == m_AccumulatedCameraForward.x && camera.forward.y == m_AccumulatedCameraForward.y && camera.forward.z == m_AccumulatedCameraForward.z
+		&& camera.fovAngle == m_AccumulatedFovAngle && geometryVersion == m_AccumulatedGeometryVersion };
+
+	if (!isUnchanged)
+	{
+		m_SampleCount = 0;
+		m_AccumulatedCameraOrigin = camera.origin;
+		m_AccumulatedCameraForward = camera.forward;
+		m_AccumulatedFovAngle = camera.fovAngle;
+		m_AccumulatedGeometryVersion = geometryVersion;
+		m_AccumulatedColors.assign(static_cast<size_t>(m_Width) * m_Height, ColorRGB{});
+	}
+
+	//First sample goes through the pixel center so a still image starts out as the regular render,
+	//the following ones walk a Halton (2, 3) sequence over the pixel
+	m_PixelOffsetX = m_SampleCount == 0 ? 0.5f : GetHalton(m_SampleCount, 2);
+	m_PixelOffsetY = m_SampleCount == 0 ? 0.5f : GetHalton(m_SampleCount, 3);
+	++m_SampleCount;
+}
+
+void Renderer::TracePrimaryHits(Scene* pScene, const Tile& tile, const Vector3& cameraOrigin, const Matrix& cameraToWorld)
+{
+	//Neighbouring primary rays are traced together as 4x4 packets
+	for (int blockY{ tile.startY }; blockY < tile.endY; blockY += RayPacket::Width)
+	{
+		for (int blockX{ tile.startX }; blockX < tile.endX; blockX += RayPacket::Width)
+		{
+			RayPacket packet{};
+			HitRecord closestHits[RayPacket::Size]{};
+
+			for (int lane{}; lane < RayPacket::Size; ++lane)
 			{
-				int k{};
+				const int px{ blockX + lane % RayPacket::Width };
+				const int py{ blockY + lane / RayPacket::Width };
+				if (px >= tile.endX || py >= tile.endY)
+					continue;
+
+				if (m_SampleCount > 1)
+					packet.SetRay(lane, cameraOrigin, m_RayGenerator.GetWorldDirection(px, py, m_PixelOffsetX, m_PixelOffsetY, cameraToWorld));
+				else
+					packet.SetRay(lane, cameraOrigin, m_RayGenerator.GetWorldDirection(px, py, cameraToWorld));
 			}
 
+			pScene->GetClosestHit(packet, closestHits);
 
-			for (const Light& pLight : lights)
+			for (int lane{}; lane < RayPacket::Size; ++lane)
 			{
-				pScene->GetClosestHit(viewRay, closestHit);
-				if (closestHit.didHit)
+				if (packet.activeMask & (1u << lane))
 				{
-					const float cosineLaw{ Vector3::Dot(closestHit.normal, LightUtils::GetDirectionToLight(pLight, closestHit.origin).Normalized()) };
+					const int pixelIdx{ blockX + lane % RayPacket::Width + (blockY + lane / RayPacket::Width) * m_Width };
+					m_PrimaryHits[pixelIdx] = closestHits[lane];
+					m_PrimaryDirections[pixelIdx] = packet.GetDirection(lane);
+				}
+			}
+		}
+	}
+}
 
-					if (cosineLaw < 0)
-					{
-						continue;
-					}
+void Renderer::ShadeTile(Scene* pScene, const Tile& tile, const std::vector<Light>& lights, const std::vector<MaterialData>& materials,
+	ShadingBatch& batch, std::vector<Occluder>& occluders, RayStatistics& statistics)
+{
+	const int tileWidth{ tile.endX - tile.startX };
+	batch.colors.assign(static_cast<size_t>(tileWidth) * (tile.endY - tile.startY), ColorRGB{});
 
-					//shadows(hard)
-					const Vector3 offsetOrigin = closestHit.normal * 0.001f;
+	const bool needsBRDF{ m_CurrentLightingMode == LightingMode::Combined || m_CurrentLightingMode == LightingMode::BRDF };
 
-					Vector3 lightDir = LightUtils::GetDirectionToLight(pLight, closestHit.origin); //offset not needed
-					const float lightrayMagnitude{ lightDir.Normalize() };
-					const Ray lightRay{ closestHit.origin + offsetOrigin,lightDir,0.0001f,lightrayMagnitude };
-					if (pScene->DoesHit(lightRay) && m_ShadowsEnabled)
-					{
+	//Exhaustive: one pass per light, so every pixel still sums its lights in scene order.
+	//Light sampling: one pass per directional light, then one pass per light sample that picks a point light for every pixel.
+	const LightTree& lightTree{ pScene->GetLightTree() };
+	const bool isLightSampling{ m_IsLightSampling && !lightTree.IsEmpty() };
+
+	GatherTileLights(pScene, tile, lights, batch, &statistics);
+	const std::vector<int>& lightIndices{ batch.lightIndices };
+
+	const int lightPassCount{ static_cast<int>(lightIndices.size()) };
+	const int passCount{ lightPassCount + (isLightSampling ? m_LightSamplesPerPixel : 0) };
+	for (int passIdx{}; passIdx < passCount; ++passIdx)
+	{
+		const bool isSampledPass{ passIdx >= lightPassCount };
+		const int passLightIdx{ isSampledPass ? -1 : lightIndices[passIdx] };
+
+		for (std::vector<ShadingSample>& samples : batch.samples)
+		{
+			samples.clear();
+		}
+
+		//Visibility first, lit hits are binned by material type
+		for (int py{ tile.startY }; py < tile.endY; ++py)
+		{
+			for (int px{ tile.startX }; px < tile.endX; ++px)
+			{
+				const int pixelIdx{ px + (py * m_Width) };
+				const int tilePixelIdx{ (px - tile.startX) + (py - tile.startY) * tileWidth };
+				const HitRecord& closestHit{ m_PrimaryHits[pixelIdx] };
+				if (!closestHit.didHit)
+					continue;
+
+				ShadingSample sample{ pixelIdx, tilePixelIdx };
+				int lightIdx{ passLightIdx };
+				if (isSampledPass)
+				{
+					float pdf{};
+					lightIdx = lightTree.Sample(closestHit.origin, closestHit.normal, GetLightSample(pixelIdx, passIdx - lightPassCount), pdf);
+					if (lightIdx < 0)
 						continue;
-					}
 
- 					const ColorRGB irradiance{ LightUtils::GetRadiance(pLight, closestHit.origin) };
-					const ColorRGB BRDF{ materials[closestHit.materialIndex]->Shade(closestHit, lightDir, -rayDirection) };
-					switch (m_CurrentLightingMode)
-					{
-					case LightingMode::Combined:
-						finalColor += irradiance * BRDF * cosineLaw;
-						break;
-					case LightingMode::ObservedArea:
-						finalColor += {cosineLaw, cosineLaw, cosineLaw};
-						break;
-					case LightingMode::Radiance:
-						finalColor += irradiance;
-						break;
-					case LightingMode::BRDF:
-						finalColor += BRDF;
-						break;
-					}
-					
+					sample.weight = 1.f / (pdf * m_LightSamplesPerPixel);
+				}
+
+				const Light& light{ lights[lightIdx] };
+				if (!SampleLight(pScene, light, closestHit, sample.cosineLaw, sample.lightDirection, occluders[lightIdx], statistics))
+					continue;
+
+				sample.irradiance = LightUtils::GetRadiance(light, closestHit.origin);
+
+				if (needsBRDF)
+				{
+					batch.samples[static_cast<int>(materials[closestHit.materialIndex].type)].push_back(sample);
+				}
+				else if (m_CurrentLightingMode == LightingMode::ObservedArea)
+				{
+					const float observedArea{ sample.cosineLaw * sample.weight };
+					batch.colors[tilePixelIdx] += { observedArea, observedArea, observedArea };
 				}
+				else
+				{
+					const ColorRGB& irradiance{ sample.irradiance };
+					batch.colors[tilePixelIdx] += irradiance * sample.weight;
+				}
+			}
+		}
+
+		//One tight loop per BRDF
+		ShadeSamples<MaterialType::SolidColor>(batch, materials);
+		ShadeSamples<MaterialType::Lambert>(batch, materials);
+		ShadeSamples<MaterialType::LambertPhong>(batch, materials);
+		ShadeSamples<MaterialType::CookTorrence>(batch, materials);
+	}
+
+	for (int py{ tile.startY }; py < tile.endY; ++py)
+	{
+		for (int px{ tile.startX }; px < tile.endX; ++px)
+		{
+			const int pixelIdx{ px + (py * m_Width) };
+			ColorRGB finalColor{ batch.colors[(px - tile.startX) + (py - tile.startY) * tileWidth] };
+
+			//Show the average of all samples so far, clamping only happens on the averaged HDR color
+			if (m_IsProgressive)
+			{
+				m_AccumulatedColors[pixelIdx] += finalColor;
+
+				//Through a const reference, the non-const operator* would scale the sum itself
+				const ColorRGB& accumulatedColor{ m_AccumulatedColors[pixelIdx] };
+				finalColor = accumulatedColor * (1.f / m_SampleCount);
+			}
+			else if (m_IsAdaptiveSampling)
+			{
+				m_PixelColors[pixelIdx] = finalColor;
 			}
 
 			//Update Color in Buffer
-			finalColor.MaxToOne();
+			m_pBufferPixels[pixelIdx] = MapColor(finalColor);
+		}
+	}
+}
+
+//Lights that are shaded one by one in the tile, all of them or only the directional ones when point lights are sampled
+void Renderer::GatherTileLights(Scene* pScene, const Tile& tile, const std::vector<Light>& lights, ShadingBatch& batch, RayStatistics* pStatistics) const
+{
+	const LightTree& lightTree{ pScene->GetLightTree() };
 
-			m_pBufferPixels[px + (py * m_Width)] = SDL_MapRGB(m_pBuffer->format,
-				static_cast<uint8_t>(finalColor.r * 255),
-				static_cast<uint8_t>(finalColor.g * 255),
-				static_cast<uint8_t>(finalColor.b * 255));
+	//Sized for every light once, so refilling them never allocates in a steady state frame
+	std::vector<int>& lightIndices{ batch.lightIndices };
+	lightIndices.clear();
+	batch.culledLightIndices.clear();
+	batch.culledLightIndices.reserve(lights.size());
+	batch.sampleLightIndices.reserve(lights.size());
+	batch.hitBounds = {};
+
+	if (m_IsLightSampling && !lightTree.IsEmpty())
+	{
+		lightIndices.insert(lightIndices.end(), lightTree.GetDirectionalLights().begin(), lightTree.GetDirectionalLights().end());
+	}
+	else
+	{
+		for (int lightIdx{}; lightIdx < static_cast<int>(lights.size()); ++lightIdx)
+		{
+			lightIndices.push_back(lightIdx);
 		}
 	}
 
-	//@END
-	//Update SDL Surface
-	SDL_UpdateWindowSurface(m_pWindow);
+	if (m_IsLightCulling)
+		CullTileLights(tile, lights, batch, pStatistics);
 }
 
-bool Renderer::SaveBufferToImage() const
+//Drops the lights that can't reach the culling threshold anywhere in the bounds of the hits of the tile, keeps the order of the rest.
+//The skipped shadow rays are only counted when pStatistics is given.
+void Renderer::CullTileLights(const Tile& tile, const std::vector<Light>& lights, ShadingBatch& batch, RayStatistics* pStatistics) const
 {
-	return SDL_SaveBMP(m_pBuffer, "RayTracing_Buffer.bmp");
+	AABB& hitBounds{ batch.hitBounds };
+	uint64_t hitCount{};
+	for (int py{ tile.startY }; py < tile.endY; ++py)
+	{
+		for (int px{ tile.startX }; px < tile.endX; ++px)
+		{
+			const HitRecord& closestHit{ m_PrimaryHits[px + (py * m_Width)] };
+			if (closestHit.didHit)
+			{
+				hitBounds.Grow(closestHit.origin);
+				++hitCount;
+			}
+		}
+	}
+
+	if (hitCount == 0)
+		return;
+
+	const auto isCulled = [&](int lightIdx)
+		{
+			const Light& light{ lights[lightIdx] };
+			if (!IsLightCulled(light, hitBounds))
+				return false;
+
+			batch.culledLightIndices.push_back(lightIdx);
+			if (!pStatistics)
+				return true;
+
+			//Only hits that face the light would have traced a shadow ray, the same cosine test SampleLight does
+			for (int py{ tile.startY }; py < tile.endY; ++py)
+			{
+				for (int px{ tile.startX }; px < tile.endX; ++px)
+				{
+					const HitRecord& closestHit{ m_PrimaryHits[px + (py * m_Width)] };
+					if (closestHit.didHit && Vector3::Dot(closestHit.normal, LightUtils::GetDirectionToLight(light, closestHit.origin)) >= 0.f)
+						++pStatistics->culledShadowRays;
+				}
+			}
+			return true;
+		};
+	std::vector<int>& lightIndices{ batch.lightIndices };
+	lightIndices.erase(std::remove_if(lightIndices.begin(), lightIndices.end(), isCulled), lightIndices.end());
+}
+
+//A point light is brightest at the point of the bounds closest to it, a directional light is equally bright everywhere
+bool Renderer::IsLightCulled(const Light& light, const AABB& bounds) const
+{
+	const Vector3 closestPoint{
+		std::clamp(light.origin.x, bounds.min.x, bounds.max.x),
+		std::clamp(light.origin.y, bounds.min.y, bounds.max.y),
+		std::clamp(light.origin.z, bounds.min.z, bounds.max.z) };
+
+	const ColorRGB maxRadiance{ LightUtils::GetRadiance(light, closestPoint) };
+	return std::max({ maxRadiance.r, maxRadiance.g, maxRadiance.b }) < m_LightCullThreshold;
+}
+
+//The culling bound only holds inside the center hits of the tile, a jittered sample can land outside of them (often on
+//another surface, that is where refinement happens). Its hit grows the bounds and the lights the tile culled are tested again.
+const std::vector<int>& Renderer::GetRefinementLights(const std::vector<Light>& lights, const HitRecord& closestHit, ShadingBatch& batch) const
+{
+	if (!closestHit.didHit || batch.culledLightIndices.empty() || batch.hitBounds.Contains(closestHit.origin))
+		return batch.lightIndices;
+
+	AABB sampleBounds{ batch.hitBounds };
+	sampleBounds.Grow(closestHit.origin);
+
+	std::vector<int>& sampleLightIndices{ batch.sampleLightIndices };
+	sampleLightIndices.assign(batch.lightIndices.begin(), batch.lightIndices.end());
+	for (const int lightIdx : batch.culledLightIndices)
+	{
+		if (!IsLightCulled(lights[lightIdx], sampleBounds))
+			sampleLightIndices.push_back(lightIdx);
+	}
+	return sampleLightIndices;
+}
+
+template<MaterialType Type>
+void Renderer::ShadeSamples(ShadingBatch& batch, const std::vector<MaterialData>& materials) const
+{
+	const bool isCombined{ m_CurrentLightingMode == LightingMode::Combined };
+
+	for (const ShadingSample& sample : batch.samples[static_cast<int>(Type)])
+	{
+		const HitRecord& closestHit{ m_PrimaryHits[sample.pixelIdx] };
+		const MaterialData& material{ materials[closestHit.materialIndex] };
+
+		ColorRGB BRDF{};
+		if constexpr (Type == MaterialType::SolidColor)
+			BRDF = MaterialShading::Shade_SolidColor(material);
+		else if constexpr (Type == MaterialType::Lambert)
+			BRDF = MaterialShading::Shade_Lambert(material);
+		else if constexpr (Type == MaterialType::LambertPhong)
+			BRDF = MaterialShading::Shade_LambertPhong(material, closestHit.normal, sample.lightDirection, -m_PrimaryDirections[sample.pixelIdx]);
+		else
+			BRDF = MaterialShading::Shade_CookTorrence(material, closestHit.normal, sample.lightDirection, -m_PrimaryDirections[sample.pixelIdx]);
+
+		const ColorRGB& constBRDF{ BRDF };
+		if (isCombined)
+			batch.colors[sample.tilePixelIdx] += sample.irradiance * constBRDF * (sample.cosineLaw * sample.weight);
+		else
+			batch.colors[sample.tilePixelIdx] += constBRDF * sample.weight;
+	}
+}
+
+//Returns the number of samples the pixel ended up with, the center sample included
+int Renderer::RefinePixel(Scene* pScene, int px, int py, const Vector3& cameraOrigin, const Matrix& cameraToWorld,
+	const std::vector<Light>& lights, ShadingBatch& batch, const std::vector<MaterialData>& materials,
+	std::vector<Occluder>& occluders, RayStatistics& statistics)
+{
+	const int pixelIdx{ px + (py * m_Width) };
+	const float luminance{ GetLuminance(m_PixelColors[pixelIdx]) };
+
+	//Edge detection on the center samples of the 4 direct neighbours
+	float contrast{};
+	if (px > 0)
+		contrast = std::max(contrast, std::abs(luminance - GetLuminance(m_PixelColors[pixelIdx - 1])));
+	if (px < m_Width - 1)
+		contrast = std::max(contrast, std::abs(luminance - GetLuminance(m_PixelColors[pixelIdx + 1])));
+	if (py > 0)
+		contrast = std::max(contrast, std::abs(luminance - GetLuminance(m_PixelColors[pixelIdx - m_Width])));
+	if (py < m_Height - 1)
+		contrast = std::max(contrast, std::abs(luminance - GetLuminance(m_PixelColors[pixelIdx + m_Width])));
+
+	if (contrast < m_ContrastThreshold)
+		return 1;
+
+	ColorRGB colorSum{ m_PixelColors[pixelIdx] };
+	float luminanceSum{ luminance };
+	float luminanceSquaredSum{ luminance * luminance };
+
+	int sampleCount{ 1 };
+	while (sampleCount < m_MaxAdaptiveSamples)
+	{
+		const Vector3 rayDirection{ m_RayGenerator.GetWorldDirection(px, py, GetHalton(sampleCount, 2), GetHalton(sampleCount, 3), cameraToWorld) };
+
+		HitRecord closestHit{};
+		pScene->GetClosestHit(Ray{ cameraOrigin, rayDirection }, closestHit);
+		++statistics.primaryRays;
+
+		const ColorRGB sampleColor{ ShadeHit(pScene, closestHit, rayDirection, lights, GetRefinementLights(lights, closestHit, batch), materials, occluders,
+			pixelIdx, sampleCount, statistics) };
+		const float sampleLuminance{ GetLuminance(sampleColor) };
+		colorSum += sampleColor;
+		luminanceSum += sampleLuminance;
+		luminanceSquaredSum += sampleLuminance * sampleLuminance;
+		++sampleCount;
+
+		//Every 4 samples, stop once the standard error of the mean is well below the edge contrast we react to.
+		//Fewer than 8 samples can all land on the same side of a thin edge, so those are never trusted.
+		if (sampleCount >= 8 && sampleCount % 4 == 0)
+		{
+			const float mean{ luminanceSum / sampleCount };
+			const float variance{ std::max(luminanceSquaredSum / sampleCount - mean * mean, 0.f) };
+			if (sqrtf(variance / sampleCount) < m_ContrastThreshold * 0.25f)
+				break;
+		}
+	}
+
+	const ColorRGB& finalColor{ colorSum };
+	m_pBufferPixels[pixelIdx] = MapColor(finalColor * (1.f / sampleCount));
+	return sampleCount;
+}
+
+ColorRGB Renderer::ShadeHit(Scene* pScene, const HitRecord& closestHit, const Vector3& rayDirection, const std::vector<Light>& lights,
+	const std::vector<int>& lightIndices, const std::vector<MaterialData>& materials, std::vector<Occluder>& occluders,
+	int pixelIdx, int subpixelSampleIdx, RayStatistics& statistics) const
+{
+	ColorRGB finalColor{};
+	if (!closestHit.didHit)
+		return finalColor;
+
+	for (const int lightIdx : lightIndices)
+	{
+		finalColor += ShadeLight(pScene, lights[lightIdx], closestHit, rayDirection, materials, occluders[lightIdx], statistics);
+	}
+
+	const LightTree& lightTree{ pScene->GetLightTree() };
+	if (!m_IsLightSampling || lightTree.IsEmpty())
+		return finalColor;
+
+	for (int lightSampleIdx{}; lightSampleIdx < m_LightSamplesPerPixel; ++lightSampleIdx)
+	{
+		float pdf{};
+		const int lightIdx{ lightTree.Sample(closestHit.origin, closestHit.normal,
+			GetLightSample(pixelIdx, subpixelSampleIdx * m_LightSamplesPerPixel + lightSampleIdx), pdf) };
+		if (lightIdx < 0)
+			continue;
+
+		const ColorRGB lightColor{ ShadeLight(pScene, lights[lightIdx], closestHit, rayDirection, materials, occluders[lightIdx], statistics) };
+		finalColor += lightColor * (1.f / (pdf * m_LightSamplesPerPixel));
+	}
+
+	return finalColor;
+}
+
+bool Renderer::SampleLight(Scene* pScene, const Light& light, const HitRecord& closestHit, float& cosineLaw, Vector3& lightDirection,
+	Occluder& occluder, RayStatistics& statistics) const
+{
+	cosineLaw = Vector3::Dot(closestHit.normal, LightUtils::GetDirectionToLight(light, closestHit.origin).Normalized());
+
+	if (cosineLaw < 0)
+	{
+		return false;
+	}
+
+	//shadows(hard)
+	const Vector3 offsetOrigin = closestHit.normal * 0.001f;
+
+	lightDirection = LightUtils::GetDirectionToLight(light, closestHit.origin); //offset not needed
+	const float lightrayMagnitude{ lightDirection.Normalize() };
+	const Ray lightRay{ closestHit.origin + offsetOrigin,lightDirection,0.0001f,lightrayMagnitude };
+	++statistics.shadowRays;
+	if (pScene->DoesHit(lightRay, occluder) && m_ShadowsEnabled)
+	{
+		return false;
+	}
+
+	return true;
+}
+
+ColorRGB Renderer::ShadeLight(Scene* pScene, const Light& light, const HitRecord& closestHit, const Vector3& rayDirection,
+	const std::vector<MaterialData>& materials, Occluder& occluder, RayStatistics& statistics) const
+{
+	float cosineLaw{};
+	Vector3 lightDir{};
+	if (!SampleLight(pScene, light, closestHit, cosineLaw, lightDir, occluder, statistics))
+	{
+		return {};
+	}
+
+	const ColorRGB irradiance{ LightUtils::GetRadiance(light, closestHit.origin) };
+	const ColorRGB BRDF{ MaterialShading::Shade(materials[closestHit.materialIndex], closestHit.normal, lightDir, -rayDirection) };
+	switch (m_CurrentLightingMode)
+	{
+	case LightingMode::Combined:
+		return irradiance * BRDF * cosineLaw;
+	case LightingMode::ObservedArea:
+		return { cosineLaw, cosineLaw, cosineLaw };
+	case LightingMode::Radiance:
+		return irradiance;
+	case LightingMode::BRDF:
+		return BRDF;
+	}
+	return {};
+}
+
+uint32_t Renderer::MapColor(ColorRGB color) const
+{
+	color.MaxToOne();
+
+	return SDL_MapRGB(m_pBuffer->format,
+		static_cast<uint8_t>(color.r * 255),
+		static_cast<uint8_t>(color.g * 255),
+		static_cast<uint8_t>(color.b * 255));
+}
+
+//Shading as it was done before the separate primary pass: single rays, and the primary hit is queried again for every light.
+//Only used to validate the fast path, keep it as simple as possible.
+uint32_t Renderer::RenderPixelReference(Scene* pScene, int px, int py, const Vector3& cameraOrigin, const Matrix& cameraToWorld,
+	const std::vector<Light>& lights, const std::vector<MaterialData>& materials) const
+{
+	const Vector3 rayDirection = m_RayGenerator.GetWorldDirection(px, py, cameraToWorld);
+
+	const Ray viewRay{ cameraOrigin, rayDirection };
+
+	ColorRGB finalColor{};
+
+	HitRecord closestHit{};
+	RayStatistics statistics{};
+
+	for (const Light& pLight : lights)
+	{
+		pScene->GetClosestHit(viewRay, closestHit);
+		if (closestHit.didHit)
+		{
+			//No occluder cache, every shadow ray runs the full query
+			Occluder occluder{};
+			finalColor += ShadeLight(pScene, pLight, closestHit, rayDirection, materials, occluder, statistics);
+		}
+	}
+
+	return MapColor(finalColor);
+}
+
+ReferenceResult Renderer::CompareWithReference(Scene* pScene) const
+{
+	if (m_SampleCount > 1)
+	{
+		std::cout << "Reference check skipped: the frame averages " << m_SampleCount << " jittered samples" << std::endl;
+		return ReferenceResult::Skipped;
+	}
+
+	if (m_IsAdaptiveSampling && !m_IsProgressive)
+	{
+		std::cout << "Reference check skipped: adaptive anti-aliasing averages up to " << m_MaxAdaptiveSamples << " jittered samples on edges" << std::endl;
+		return ReferenceResult::Skipped;
+	}
+
+	if (m_IsLightSampling)
+	{
+		std::cout << "Reference check skipped: light sampling only shades " << m_LightSamplesPerPixel << " random point lights per pixel" << std::endl;
+		return ReferenceResult::Skipped;
+	}
+
+	if (m_IsLightCulling)
+	{
+		std::cout << "Reference check skipped: lights below a radiance of " << m_LightCullThreshold << " are culled per tile" << std::endl;
+		return ReferenceResult::Skipped;
+	}
+
+	Camera& camera = pScene->GetCamera();
+	auto& materials = pScene->GetMaterialTable();
+	auto& lights = pScene->GetLights();
+
+	//Uses the ray directions of the last rendered frame, this checks intersection and shading, not ray generation
+	const Matrix cameraToWorld = camera.CalculateCameraToWorld();
+
+	std::vector<uint32_t> referencePixels(static_cast<size_t>(m_Width) * m_Height);
+	m_pTileScheduler->Run([&](const Tile& tile, int)
+		{
+			for (int py{ tile.startY }; py < tile.endY; ++py)
+			{
+				for (int px{ tile.startX }; px < tile.endX; ++px)
+				{
+					referencePixels[px + (py * m_Width)] = RenderPixelReference(pScene, px, py, camera.origin, cameraToWorld, lights, materials);
+				}
+			}
+		});
+
+	int differentPixels{};
+	int maxChannelDifference{};
+	for (int pixelIdx{}; pixelIdx < m_Width * m_Height; ++pixelIdx)
+	{
+		if (referencePixels[pixelIdx] == m_pBufferPixels[pixelIdx])
+			continue;
+
+		++differentPixels;
+
+		uint8_t referenceColor[3]{};
+		uint8_t color[3]{};
+		SDL_GetRGB(referencePixels[pixelIdx], m_pBuffer->format, &referenceColor[0], &referenceColor[1], &referenceColor[2]);
+		SDL_GetRGB(m_pBufferPixels[pixelIdx], m_pBuffer->format, &color[0], &color[1], &color[2]);
+		for (int channel{}; channel < 3; ++channel)
+		{
+			maxChannelDifference = std::max(maxChannelDifference, std::abs(referenceColor[channel] - color[channel]));
+		}
+	}
+
+	if (differentPixels == 0)
+	{
+		std::cout << "Reference check passed: frame matches the reference render" << std::endl;
+		return ReferenceResult::Passed;
+	}
+
+	std::cout << "Reference check FAILED: " << differentPixels << " pixels differ, max channel difference " << maxChannelDifference << std::endl;
+	return ReferenceResult::Failed;
+}
+
+bool Renderer::SaveBufferToImage(const char* filePath) const
+{
+	return SDL_SaveBMP(m_pBuffer, filePath);
+}
+
+float Renderer::GetHalton(int index, int base)
+{
+	float result{};
+	float fraction{ 1.f / base };
+	while (index > 0)
+	{
+		result += fraction * (index % base);
+		index /= base;
+		fraction /= base;
+	}
+	return result;
+}
+
+float Renderer::GetLightSample(int pixelIdx, int lightSampleIdx) const
+{
+	//Without progressive rendering m_SampleCount stays 0, so a still frame keeps the same picks instead of flickering
+	const uint32_t hash{ Hash(static_cast<uint32_t>(pixelIdx) + Hash(static_cast<uint32_t>(lightSampleIdx) + Hash(static_cast<uint32_t>(m_SampleCount)))) };
+	return static_cast<float>(hash >> 8) * (1.f / 16777216.f);
+}
+
+//PCG output permutation, cheap enough to hash every light pick and without visible patterns between neighbouring pixels
+uint32_t Renderer::Hash(uint32_t value)
+{
+	const uint32_t state{ value * 747796405u + 2891336453u };
+	const uint32_t word{ ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u };
+	return (word >> 22u) ^ word;
+}
+
+//Luminance of the displayed (clamped) color, so bright HDR spots don't trigger refinement everywhere
+float Renderer::GetLuminance(ColorRGB color)
+{
+	color.MaxToOne();
+	return 0.2126f * color.r + 0.7152f * color.g + 0.0722f * color.b;
 }
 
 void Renderer::CycleLightingMode()
 {
+	m_SampleCount = 0;
+
 	switch(m_CurrentLightingMode)
 	{
 	case LightingMode::ObservedArea:
@@ -1,8 +1,11 @@
 #pragma once
 
 #include <cstdint>
+#include <vector>
 
 #include "DataTypes.h"
+#include "CameraRayGenerator.h"
+#include "Material.h"
 
 struct SDL_Window;
 struct SDL_Surface;
@@ -10,29 +13,157 @@ struct SDL_Surface;
 namespace dae
 {
 	class Scene;
+	struct Camera;
+	class TileScheduler;
+	struct Tile;
+	struct Light;
+
+	struct RayStatistics
+	{
+		uint64_t primaryRays{};
+		uint64_t shadowRays{};
+		//Shadow rays light culling saved the center samples, hits facing away from a culled light would not have traced one
+		uint64_t culledShadowRays{};
+	};
+
+	//Outcome of Renderer::CompareWithReference, frames that can't match the reference path by design are skipped
+	enum class ReferenceResult
+	{
+		Passed,
+		Failed,
+		Skipped
+	};
 
 	class Renderer final
 	{
 	public:
 		Renderer(SDL_Window* pWindow);
-		~Renderer() = default;
+		//Headless renderer, draws into an in-memory surface instead of a window
+		Renderer(int width, int height);
+		~Renderer();
 
 		Renderer(const Renderer&) = delete;
 		Renderer(Renderer&&) noexcept = delete;
 		Renderer& operator=(const Renderer&) = delete;
 		Renderer& operator=(Renderer&&) noexcept = delete;
 
-		void Render(Scene* pScene) const;
-		bool SaveBufferToImage() const;
+		//False when SDL couldn't create the surface to draw into, nothing else may be called then
+		bool HasBuffer() const { return m_pBuffer != nullptr; }
+
+		void Render(Scene* pScene);
+		bool SaveBufferToImage(const char* filePath = "RayTracing_Buffer.bmp") const;
+
+		//Renders the current frame again with the reference path (one closest hit query per light)
+		//and reports every pixel that differs from the last rendered frame
+		ReferenceResult CompareWithReference(Scene* pScene) const;
 
 		void CycleLightingMode();
-		void ToggleShadows() { m_ShadowsEnabled = !m_ShadowsEnabled; }
+		void ToggleShadows() { m_ShadowsEnabled = !m_ShadowsEnabled; m_SampleCount = 0; }
+		//Averages jittered samples over frames while camera and scene stay unchanged
+		void ToggleProgressiveRendering() { m_IsProgressive = !m_IsProgressive; m_SampleCount = 0; m_pWarmScene = nullptr; }
+		int GetSampleCount() const { return m_SampleCount; }
+
+		//Adaptive anti-aliasing: pixels that contrast with a neighbour by more than contrastThreshold (luminance, 0-1)
+		//get extra jittered samples until their estimate settles or maxSamples is reached. Not used while progressive.
+		void ToggleAdaptiveSampling() { m_IsAdaptiveSampling = !m_IsAdaptiveSampling; m_pWarmScene = nullptr; }
+		void SetAdaptiveSampling(bool isEnabled, int maxSamples, float contrastThreshold);
+		bool IsAdaptiveSampling() const { return m_IsAdaptiveSampling; }
+		//Number of pixels per sample count (index 1 to maxSamples) in the last adaptive frame
+		std::vector<uint64_t> GetSampleDistribution() const;
+
+		//Light sampling: directional lights are still shaded one by one, but every pixel only shades samplesPerPixel point lights,
+		//picked from the light tree by their radiance at the hit. Off by default, the exhaustive light loop is the reference.
+		void ToggleLightSampling() { m_IsLightSampling = !m_IsLightSampling; m_SampleCount = 0; }
+		void SetLightSampling(bool isEnabled, int samplesPerPixel);
+		bool IsLightSampling() const { return m_IsLightSampling; }
+
+		//Light culling: before a tile is shaded, lights whose radiance stays below threshold (brightest channel) everywhere
+		//in the bounds of the hits of the tile are dropped for the whole tile. Adaptive refinement samples test the dropped lights
+		//again when they hit outside of those bounds.
+		void ToggleLightCulling() { m_IsLightCulling = !m_IsLightCulling; m_SampleCount = 0; }
+		void SetLightCulling(bool isEnabled, float threshold);
+		bool IsLightCulling() const { return m_IsLightCulling; }
+
+		int GetWidth() const { return m_Width; }
+		int GetHeight() const { return m_Height; }
+
+		//Recreates the worker pool, 0 uses one thread per hardware thread
+		void SetThreadCount(int threadCount);
+		int GetThreadCount() const;
+		//Rays traced during the last Render call
+		RayStatistics GetRayStatistics() const;
 
 	private:
 		SDL_Window* m_pWindow{};
 
 		SDL_Surface* m_pBuffer{};
 		uint32_t* m_pBufferPixels{};
+		bool m_OwnsBuffer{ false }; //only the headless surface is ours to free, the window surface belongs to SDL
+
+		TileScheduler* m_pTileScheduler{};
+
+		CameraRayGenerator m_RayGenerator{};
+
+		//Primary visibility of the frame, filled before the shading pass reads it
+		std::vector<HitRecord> m_PrimaryHits{};
+		std::vector<Vector3> m_PrimaryDirections{};
+
+		//One entry per scheduler thread, only written once per tile
+		std::vector<RayStatistics> m_ThreadRayStatistics{};
+
+		//Scene of the last frame while nothing was resized since, debug builds assert that its next frames don't allocate
+		const Scene* m_pWarmScene{ nullptr };
+
+		//Progressive rendering, m_AccumulatedColors holds the unclamped sum of m_SampleCount samples per pixel
+		bool m_IsProgressive{ false };
+		int m_SampleCount{};
+		float m_PixelOffsetX{ 0.5f };
+		float m_PixelOffsetY{ 0.5f };
+		std::vector<ColorRGB> m_AccumulatedColors{};
+
+		//Adaptive anti-aliasing, m_PixelColors keeps the unclamped center sample of every pixel for the refinement pass
+		bool m_IsAdaptiveSampling{ false };
+		int m_MaxAdaptiveSamples{ 16 };
+		float m_ContrastThreshold{ 0.1f };
+		std::vector<ColorRGB> m_PixelColors{};
+		std::vector<std::vector<uint64_t>> m_ThreadSampleHistograms{};
+
+		//Stochastic light selection, see ToggleLightSampling
+		bool m_IsLightSampling{ false };
+		int m_LightSamplesPerPixel{ 4 };
+
+		//Per tile light culling, see ToggleLightCulling
+		bool m_IsLightCulling{ false };
+		float m_LightCullThreshold{ 0.01f };
+
+		//Lit hits of one light in one tile, binned by material type so every BRDF runs over a batch at once
+		struct ShadingSample
+		{
+			int pixelIdx{};
+			int tilePixelIdx{};
+			float cosineLaw{};
+			Vector3 lightDirection{};
+			ColorRGB irradiance{};
+			float weight{ 1.f }; //1 / (pdf * sample count) for a sampled light
+		};
+		struct ShadingBatch
+		{
+			std::vector<ColorRGB> colors{}; //HDR color of every tile pixel
+			std::vector<ShadingSample> samples[MaterialTypeCount]{};
+			std::vector<int> lightIndices{}; //lights that get a pass of their own in this tile
+			std::vector<int> culledLightIndices{}; //lights culling dropped for this tile
+			std::vector<int> sampleLightIndices{}; //lights of one refinement sample, see GetRefinementLights
+			AABB hitBounds{}; //bounds of the center hits of the tile, the culling bound holds inside them
+		};
+		std::vector<ShadingBatch> m_ThreadShadingBatches{};
+
+		//Last occluder per light of every scheduler thread, emptied at the start of each tile
+		std::vector<std::vector<Occluder>> m_ThreadOccluders{};
+
+		Vector3 m_AccumulatedCameraOrigin{};
+		Vector3 m_AccumulatedCameraForward{};
+		float m_AccumulatedFovAngle{};
+		uint32_t m_AccumulatedGeometryVersion{};
 
 		int m_Width{};
 		int m_Height{};
@@ -47,5 +178,39 @@ namespace dae
 
 		LightingMode m_CurrentLightingMode{ LightingMode::Combined };
 		bool m_ShadowsEnabled{ true };
+
+		void InitializeBuffers();
+		void TracePrimaryHits(Scene* pScene, const Tile& tile, const Vector3& cameraOrigin, const Matrix& cameraToWorld);
+		void UpdateAccumulation(const Camera& camera, uint32_t geometryVersion);
+		void ShadeTile(Scene* pScene, const Tile& tile, const std::vector<Light>& lights, const std::vector<MaterialData>& materials,
+			ShadingBatch& batch, std::vector<Occluder>& occluders, RayStatistics& statistics);
+		void GatherTileLights(Scene* pScene, const Tile& tile, const std::vector<Light>& lights, ShadingBatch& batch, RayStatistics* pStatistics) const;
+		void CullTileLights(const Tile& tile, const std::vector<Light>& lights, ShadingBatch& batch, RayStatistics* pStatistics) const;
+		bool IsLightCulled(const Light& light, const AABB& bounds) const;
+		const std::vector<int>& GetRefinementLights(const std::vector<Light>& lights, const HitRecord& closestHit, ShadingBatch& batch) const;
+		template<MaterialType Type>
+		void ShadeSamples(ShadingBatch& batch, const std::vector<MaterialData>& materials) const;
+		int RefinePixel(Scene* pScene, int px, int py, const Vector3& cameraOrigin, const Matrix& cameraToWorld,
+			const std::vector<Light>& lights, ShadingBatch& batch, const std::vector<MaterialData>& materials,
+			std::vector<Occluder>& occluders, RayStatistics& statistics);
+		//Shades the lights of lightIndices one by one, then the point light samples when light sampling is on.
+		//subpixelSampleIdx keeps the light picks of the samples of one pixel apart
+		ColorRGB ShadeHit(Scene* pScene, const HitRecord& closestHit, const Vector3& rayDirection, const std::vector<Light>& lights,
+			const std::vector<int>& lightIndices, const std::vector<MaterialData>& materials, std::vector<Occluder>& occluders,
+			int pixelIdx, int subpixelSampleIdx, RayStatistics& statistics) const;
+		//Cosine and shadow test, false when the light doesn't reach the hit. occluder is the shadow ray cache of this light.
+		bool SampleLight(Scene* pScene, const Light& light, const HitRecord& closestHit, float& cosineLaw, Vector3& lightDirection,
+			Occluder& occluder, RayStatistics& statistics) const;
+		ColorRGB ShadeLight(Scene* pScene, const Light& light, const HitRecord& closestHit, const Vector3& rayDirection,
+			const std::vector<MaterialData>& materials, Occluder& occluder, RayStatistics& statistics) const;
+		uint32_t MapColor(ColorRGB color) const;
+		static float GetHalton(int index, int base);
+		//Uniform number in [0, 1) for the lightSampleIdx-th light pick of a pixel, changes with every progressive sample
+		float GetLightSample(int pixelIdx, int lightSampleIdx) const;
+		static uint32_t Hash(uint32_t value);
+		static float GetLuminance(ColorRGB color);
+
+		uint32_t RenderPixelReference(Scene* pScene, int px, int py, const Vector3& cameraOrigin, const Matrix& cameraToWorld,
+			const std::vector<Light>& lights, const std::vector<MaterialData>& materials) const;
 	};
 }
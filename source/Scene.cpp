@@ -1,17 +1,24 @@
 #include "Scene.h"
 #include "Utils.h"
 #include "Material.h"
+#include "MeshCache.h"
+
+#include <algorithm>
+#include <bit>
 
 namespace dae {
 
 #pragma region Base Scene
 	//Initialize Scene with Default Solid Color Material (RED)
-	Scene::Scene():
-		m_Materials({ new Material_SolidColor({1,0,0})})
+	Scene::Scene()
 	{
+		AddMaterial(new Material_SolidColor({ 1,0,0 }));
+
 		m_SphereGeometries.reserve(32);
 		m_PlaneGeometries.reserve(32);
 		m_TriangleMeshGeometries.reserve(32);
+		m_InstancedMeshGeometries.reserve(32);
+		m_TriangleMeshInstances.reserve(32);
 		m_Lights.reserve(32);
 	}
 
@@ -31,79 +38,529 @@ namespace dae {
 		//todo W1
 		//assert(false && "No Implemented Yet!");
 
-		HitRecord currentHitRecord{};
+		//The search only tracks distance and primitive, the hit record is made once for the final hit
+		HitCandidate closest{};
+		closest.t = closestHit.t;
+
+		const std::vector<BVHNode>& nodes{ m_TopLevelBVH.GetNodes() };
+		const std::vector<int>& primitiveIndices{ m_TopLevelBVH.GetPrimitiveIndices() };
+		const int sphereCount{ static_cast<int>(m_SphereGeometries.size()) };
+
+		//Every accepted hit shrinks the search interval, so farther nodes, primitives and mesh triangles are rejected right away.
+		//The traversal shrinks the same max, a hit has to be strictly closer to replace the current one so ties keep the first hit.
+		Ray nearestRay{ ray };
+		nearestRay.max = std::min(ray.max, closestHit.t);
+
+		const auto acceptHit = [&](const HitCandidate& hit)
+			{
+				if (hit.t >= closest.t)
+					return;
+
+				closest = hit;
+				nearestRay.max = hit.t;
+			};
 
-		for (const auto& sphere : m_SphereGeometries)//loop over spheres
+		m_TopLevelBVH.Traverse(ray.origin, ray.direction, ray.min, nearestRay.max, [&](const BVHNode& leaf, float&)
+			{
+				//All spheres of the leaf in one SIMD run
+				const SphereRun& sphereRun{ m_LeafSphereRuns[&leaf - nodes.data()] };
+				float t{};
+				const int slot{ GeometryUtils::HitTest_Spheres(m_SphereSoA, sphereRun.first, sphereRun.count, nearestRay, nearestRay.max, t) };
+				if (slot >= 0)
+				{
+					acceptHit({ t, PrimitiveType::Sphere, m_SphereSoA.sphereIndices[slot] });
+				}
+
+				HitCandidate hit{};
+				for (int idx{ leaf.leftFirst }; idx < leaf.leftFirst + leaf.primitiveCount; ++idx)//loop over meshes and triangles in this leaf
+				{
+					if (primitiveIndices[idx] >= sphereCount && HitTest_TopLevelPrimitive(primitiveIndices[idx], nearestRay, hit))
+					{
+						acceptHit(hit);
+					}
+				}
+				return false;
+			});
+
+		for (int planeIdx{}; planeIdx < static_cast<int>(m_PlaneGeometries.size()); ++planeIdx)//loop over planes
 		{
-			if(GeometryUtils::HitTest_Sphere(sphere, ray, currentHitRecord))
+			float t{};
+			if (GeometryUtils::HitTest_Plane(m_PlaneGeometries[planeIdx], nearestRay, t))
 			{
-				closestHit = currentHitRecord;
+				acceptHit({ t, PrimitiveType::Plane, planeIdx });
 			}
 		}
 
-		for(const auto& triangle : m_Triangles)//loop over triangles
+		if (closest.primitiveType != PrimitiveType::None)
 		{
-			if(GeometryUtils::HitTest_Triangle(triangle,ray, currentHitRecord))
-			{
-				closestHit = currentHitRecord;
-			}
+			ResolveHit(ray, closest, closestHit);
 		}
+	}
 
-		for (const auto& triangleMesh : m_TriangleMeshGeometries)//loop over triangle meshes
+	void Scene::GetClosestHit(RayPacket& packet, HitRecord* closestHits) const
+	{
+		//Rays heading into different octants split up right away, trace those one by one
+		if (!packet.IsCoherent())
 		{
-			if (GeometryUtils::HitTest_TriangleMesh(triangleMesh, ray, currentHitRecord))
+			for (uint32_t lanes{ packet.activeMask }; lanes != 0; lanes &= lanes - 1)
 			{
-				closestHit = currentHitRecord;
+				const int lane{ std::countr_zero(lanes) };
+				GetClosestHit(Ray{ packet.GetOrigin(lane), packet.GetDirection(lane), packet.min, packet.max[lane] }, closestHits[lane]);
 			}
+			return;
 		}
 
-		for (const auto& plane : m_PlaneGeometries)//loop over planes
+		HitCandidate hits[RayPacket::Size]{};
+		for (int lane{}; lane < RayPacket::Size; ++lane)
 		{
-			if(GeometryUtils::HitTest_Plane(plane, ray, currentHitRecord))
+			hits[lane].t = closestHits[lane].t;
+		}
+
+		const std::vector<BVHNode>& nodes{ m_TopLevelBVH.GetNodes() };
+		const std::vector<int>& primitiveIndices{ m_TopLevelBVH.GetPrimitiveIndices() };
+		const int sphereCount{ static_cast<int>(m_SphereGeometries.size()) };
+		const int meshCount{ static_cast<int>(m_TriangleMeshGeometries.size()) };
+
+		m_TopLevelBVH.TraversePacket(packet, packet.activeMask, [&](const BVHNode& leaf, uint32_t laneMask)
 			{
-				if (currentHitRecord.t < closestHit.t)
+				const SphereRun& sphereRun{ m_LeafSphereRuns[&leaf - nodes.data()] };
+				for (int slot{ sphereRun.first }; slot < sphereRun.first + sphereRun.count; ++slot)
 				{
-					closestHit = currentHitRecord;
+					const int sphereIdx{ m_SphereSoA.sphereIndices[slot] };
+					if (sphereIdx >= 0)
+						GeometryUtils::HitTest_Sphere(m_SphereGeometries[sphereIdx], sphereIdx, packet, laneMask, hits);
 				}
-			}
+
+				HitCandidate hit{};
+				for (int idx{ leaf.leftFirst }; idx < leaf.leftFirst + leaf.primitiveCount; ++idx)
+				{
+					const int primitiveIdx{ primitiveIndices[idx] };
+					if (primitiveIdx < sphereCount)
+						continue;
+
+					//Meshes keep the packet together, instances and loose triangles fall back to single rays
+					if (primitiveIdx - sphereCount < meshCount)
+					{
+						const int meshIdx{ primitiveIdx - sphereCount };
+						GeometryUtils::HitTest_TriangleMesh(m_TriangleMeshGeometries[meshIdx], meshIdx, packet, laneMask, hits);
+						continue;
+					}
+
+					for (uint32_t lanes{ laneMask }; lanes != 0; lanes &= lanes - 1)
+					{
+						const int lane{ std::countr_zero(lanes) };
+						const Ray ray{ packet.GetOrigin(lane), packet.GetDirection(lane), packet.min, packet.max[lane] };
+						if (HitTest_TopLevelPrimitive(primitiveIdx, ray, hit) && hit.t < hits[lane].t)
+						{
+							hits[lane] = hit;
+							packet.max[lane] = hit.t;
+						}
+					}
+				}
+			});
+
+		for (int planeIdx{}; planeIdx < static_cast<int>(m_PlaneGeometries.size()); ++planeIdx)//loop over planes
+		{
+			GeometryUtils::HitTest_Plane(m_PlaneGeometries[planeIdx], planeIdx, packet, packet.activeMask, hits);
+		}
+
+		for (uint32_t lanes{ packet.activeMask }; lanes != 0; lanes &= lanes - 1)
+		{
+			const int lane{ std::countr_zero(lanes) };
+			if (hits[lane].primitiveType != PrimitiveType::None)
+				ResolveHit(Ray{ packet.GetOrigin(lane), packet.GetDirection(lane) }, hits[lane], closestHits[lane]);
 		}
 	}
 
 	bool Scene::DoesHit(const Ray& ray) const
+	{
+		Occluder occluder{};
+		return DoesHit(ray, occluder);
+	}
+
+	bool Scene::DoesHit(const Ray& ray, Occluder& occluder) const
 	{
 		//todo W3
 		//assert(false && "No Implemented Yet!");
-		HitRecord currentHitRecord{};
 
-		for (const auto& sphere : m_SphereGeometries)//loop over spheres
+		//Neighbouring shadow rays towards the same light are mostly blocked by the same primitive
+		if (occluder.primitiveType != PrimitiveType::None && HitTest_Occluder(occluder, ray))
 		{
-			if (GeometryUtils::HitTest_Sphere(sphere, ray))
+			return true;
+		}
+
+		const std::vector<BVHNode>& nodes{ m_TopLevelBVH.GetNodes() };
+		const int sphereCount{ static_cast<int>(m_SphereGeometries.size()) };
+
+		//Any hit traversal, the first primitive that blocks the ray ends the query
+		float tMax{ ray.max };
+		const bool didHit = m_TopLevelBVH.Traverse(ray.origin, ray.direction, ray.min, tMax, [&](const BVHNode& leaf, float&)
 			{
-				return true;
-			}
+				//One SIMD run over all spheres of the leaf is cheaper than any other primitive test, so it goes first
+				const SphereRun& sphereRun{ m_LeafSphereRuns[&leaf - nodes.data()] };
+				float t{};
+				const int slot{ GeometryUtils::HitTest_Spheres(m_SphereSoA, sphereRun.first, sphereRun.count, ray, ray.max, t, true) };
+				if (slot >= 0)
+				{
+					occluder = { PrimitiveType::Sphere, m_SphereSoA.sphereIndices[slot] };
+					return true;
+				}
+
+				for (int idx{ leaf.leftFirst }; idx < leaf.leftFirst + leaf.primitiveCount; ++idx)
+				{
+					const int primitiveIdx{ m_TopLevelOcclusionOrder[idx] };
+					if (primitiveIdx >= sphereCount && HitTest_TopLevelPrimitive(primitiveIdx, ray, occluder))
+					{
+						return true;
+					}
+				}
+				return false;
+			});
+
+		if (didHit)
+		{
+			return true;
 		}
-		for (const auto& triangle : m_Triangles)//loop over triangles
+
+		for (int planeIdx{}; planeIdx < static_cast<int>(m_PlaneGeometries.size()); ++planeIdx)//loop over planes
 		{
-			if (GeometryUtils::HitTest_Triangle(triangle, ray))
+			if (GeometryUtils::HitTest_Plane(m_PlaneGeometries[planeIdx], ray))
 			{
+				occluder = { PrimitiveType::Plane, planeIdx };
 				return true;
 			}
 		}
-		for (const auto& triangleMesh : m_TriangleMeshGeometries)//loop over triangles meshes
+		return false;
+	}
+
+	void Scene::GetClosestHitReference(const Ray& ray, HitRecord& closestHit) const
+	{
+		HitRecord currentHitRecord{};
+		const auto acceptHit = [&]()
+			{
+				if (currentHitRecord.t < closestHit.t)
+					closestHit = currentHitRecord;
+			};
+
+		for (const auto& sphere : m_SphereGeometries)
+		{
+			if (GeometryUtils::HitTest_Sphere(sphere, ray, currentHitRecord))
+				acceptHit();
+		}
+
+		for (const auto& plane : m_PlaneGeometries)
+		{
+			if (GeometryUtils::HitTest_Plane(plane, ray, currentHitRecord))
+				acceptHit();
+		}
+
+		for (const auto& triangleMesh : m_TriangleMeshGeometries)
+		{
+			if (GeometryUtils::HitTest_TriangleMeshReference(triangleMesh, ray, currentHitRecord))
+				acceptHit();
+		}
+
+		for (const auto& instance : m_TriangleMeshInstances)
 		{
-			if (GeometryUtils::HitTest_TriangleMesh(triangleMesh, ray))
+			if (HitTest_InstanceReference(instance, ray, currentHitRecord, false))
+				acceptHit();
+		}
+
+		for (const auto& triangle : m_Triangles)
+		{
+			if (GeometryUtils::HitTest_Triangle(triangle, ray, currentHitRecord))
+				acceptHit();
+		}
+	}
+
+	bool Scene::DoesHitReference(const Ray& ray) const
+	{
+		HitRecord currentHitRecord{};
+		return std::any_of(m_SphereGeometries.begin(), m_SphereGeometries.end(), [&](const Sphere& sphere) { return GeometryUtils::HitTest_Sphere(sphere, ray); })
+			|| std::any_of(m_PlaneGeometries.begin(), m_PlaneGeometries.end(), [&](const Plane& plane) { return GeometryUtils::HitTest_Plane(plane, ray); })
+			|| std::any_of(m_TriangleMeshGeometries.begin(), m_TriangleMeshGeometries.end(),
+				[&](const TriangleMesh& triangleMesh) { return GeometryUtils::HitTest_TriangleMeshReference(triangleMesh, ray, currentHitRecord, true); })
+			|| std::any_of(m_TriangleMeshInstances.begin(), m_TriangleMeshInstances.end(),
+				[&](const TriangleMeshInstance& instance) { return HitTest_InstanceReference(instance, ray, currentHitRecord, true); })
+			|| std::any_of(m_Triangles.begin(), m_Triangles.end(), [&](const Triangle& triangle) { return GeometryUtils::HitTest_Triangle(triangle, ray); });
+	}
+
+	bool Scene::HitTest_InstanceReference(const TriangleMeshInstance& instance, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord) const
+	{
+		const TriangleMesh& mesh{ m_InstancedMeshGeometries[instance.meshIndex] };
+		return GeometryUtils::HitTest_Instance(instance, ray, hitRecord, ignoreHitRecord, [&mesh](const Ray& objectRay, HitRecord& objectHitRecord, bool ignoreObjectHitRecord)
 			{
-				return true;
-			}
+				return GeometryUtils::HitTest_TriangleMeshReference(mesh, objectRay, objectHitRecord, ignoreObjectHitRecord);
+			});
+	}
+
+	void Scene::UpdateAccelerationStructure()
+	{
+		const int sphereCount{ static_cast<int>(m_SphereGeometries.size()) };
+		const int meshCount{ static_cast<int>(m_TriangleMeshGeometries.size()) };
+		const int instanceCount{ static_cast<int>(m_TriangleMeshInstances.size()) };
+		const int triangleCount{ static_cast<int>(m_Triangles.size()) };
+
+		m_LightTree.Update(m_Lights);
+
+		m_TopLevelBounds.resize(sphereCount + meshCount + instanceCount + triangleCount);
+
+		//Object counts and transform versions only ever grow, so their sum changes with every edit
+		uint64_t geometryState{ m_PlaneGeometries.size() + m_TopLevelBounds.size() };
+		for (const auto& triangleMesh : m_TriangleMeshGeometries)
+			geometryState += triangleMesh.version;
+		for (const auto& instance : m_TriangleMeshInstances)
+			geometryState += instance.version;
+
+		if (geometryState != m_PreviousGeometryState)
+		{
+			m_PreviousGeometryState = geometryState;
+			++m_GeometryVersion;
+		}
+
+		int primitiveIdx{};
+		for (const auto& sphere : m_SphereGeometries)
+		{
+			const Vector3 extent{ sphere.radius, sphere.radius, sphere.radius };
+			m_TopLevelBounds[primitiveIdx++] = { sphere.origin - extent, sphere.origin + extent };
+		}
+
+		for (const auto& triangleMesh : m_TriangleMeshGeometries)
+		{
+			//Empty meshes get a degenerate box, they never report a hit anyway
+			m_TopLevelBounds[primitiveIdx++] = triangleMesh.bvh.IsEmpty() ? AABB{ Vector3::Zero, Vector3::Zero } : triangleMesh.bvh.GetBounds();
+		}
+
+		for (const auto& instance : m_TriangleMeshInstances)
+		{
+			const TriangleMesh& mesh{ m_InstancedMeshGeometries[instance.meshIndex] };
+			m_TopLevelBounds[primitiveIdx++] = mesh.bvh.IsEmpty() ? AABB{ Vector3::Zero, Vector3::Zero } : instance.GetBounds(mesh.bvh.GetBounds());
+		}
+
+		for (const auto& triangle : m_Triangles)
+		{
+			AABB& bounds{ m_TopLevelBounds[primitiveIdx++] };
+			bounds = {};
+			bounds.Grow(triangle.v0);
+			bounds.Grow(triangle.v1);
+			bounds.Grow(triangle.v2);
+		}
+
+		//Only update when an object was added or moved since the last update
+		bool isUpToDate{ m_TopLevelPreviousBounds.size() == m_TopLevelBounds.size() };
+		for (int idx{}; isUpToDate && idx < static_cast<int>(m_TopLevelBounds.size()); ++idx)
+		{
+			const AABB& current{ m_TopLevelBounds[idx] };
+			const AABB& built{ m_TopLevelPreviousBounds[idx] };
+			isUpToDate = current.min.x == built.min.x && current.min.y == built.min.y && current.min.z == built.min.z
+				&& current.max.x == built.max.x && current.max.y == built.max.y && current.max.z == built.max.z;
 		}
-		for (const auto& plane : m_PlaneGeometries)//loop over planes
+
+		if (isUpToDate)
+			return;
+
+		//Spheres and triangles have no version, a change of their bounds counts as an edit too
+		++m_GeometryVersion;
+
+		//Moved objects only need a refit, added or removed ones (or a degraded tree) a full build
+		if (m_TopLevelBVH.GetPrimitiveCount() == static_cast<int>(m_TopLevelBounds.size()))
+			m_TopLevelBVH.Refit(m_TopLevelBounds);
+
+		if (m_TopLevelBVH.GetPrimitiveCount() != static_cast<int>(m_TopLevelBounds.size()) || m_TopLevelBVH.NeedsRebuild())
+			m_TopLevelBVH.Build(m_TopLevelBounds, TopLevelLeafSize);
+
+		m_TopLevelPreviousBounds = m_TopLevelBounds;
+
+		UpdateSphereSoA();
+		UpdateOcclusionOrder();
+	}
+
+	void Scene::UpdateSphereSoA()
+	{
+		const std::vector<BVHNode>& nodes{ m_TopLevelBVH.GetNodes() };
+		const std::vector<int>& primitiveIndices{ m_TopLevelBVH.GetPrimitiveIndices() };
+		const int sphereCount{ static_cast<int>(m_SphereGeometries.size()) };
+
+		m_SphereSoA.Clear();
+		m_LeafSphereRuns.assign(nodes.size(), {});
+
+		for (int nodeIdx{}; nodeIdx < static_cast<int>(nodes.size()); ++nodeIdx)
 		{
-			if (GeometryUtils::HitTest_Plane(plane, ray))
+			const BVHNode& node{ nodes[nodeIdx] };
+			if (!node.IsLeaf())
+				continue;
+
+			SphereRun& run{ m_LeafSphereRuns[nodeIdx] };
+			run.first = m_SphereSoA.GetSize();
+			for (int idx{ node.leftFirst }; idx < node.leftFirst + node.primitiveCount; ++idx)
 			{
-				return true;
+				if (primitiveIndices[idx] < sphereCount)
+					m_SphereSoA.Add(m_SphereGeometries[primitiveIndices[idx]], primitiveIndices[idx]);
 			}
+			m_SphereSoA.PadToWidth();
+			run.count = m_SphereSoA.GetSize() - run.first;
+		}
+	}
+
+	void Scene::UpdateOcclusionOrder()
+	{
+		//A random segment through a leaf hits a convex object about as often as the surface area of the object,
+		//so the bounds with the largest area get tested first. Closest hit queries keep the build order for their ties.
+		m_TopLevelOcclusionOrder = m_TopLevelBVH.GetPrimitiveIndices();
+		for (const BVHNode& node : m_TopLevelBVH.GetNodes())
+		{
+			if (!node.IsLeaf())
+				continue;
+
+			const auto first{ m_TopLevelOcclusionOrder.begin() + node.leftFirst };
+			std::sort(first, first + node.primitiveCount, [this](int left, int right)
+				{
+					const float leftArea{ m_TopLevelBounds[left].GetSurfaceArea() };
+					const float rightArea{ m_TopLevelBounds[right].GetSurfaceArea() };
+					return leftArea > rightArea || (leftArea == rightArea && left < right);
+				});
+		}
+	}
+
+	bool Scene::HitTest_TopLevelPrimitive(int primitiveIdx, const Ray& ray, HitCandidate& hit) const
+	{
+		//Spheres are tested per leaf through the SoA runs
+		primitiveIdx -= static_cast<int>(m_SphereGeometries.size());
+
+		const int meshCount{ static_cast<int>(m_TriangleMeshGeometries.size()) };
+		if (primitiveIdx < meshCount)
+		{
+			hit.primitiveType = PrimitiveType::TriangleMesh;
+			hit.primitiveIdx = primitiveIdx;
+			return GeometryUtils::HitTest_TriangleMesh(m_TriangleMeshGeometries[primitiveIdx], ray, hit);
+		}
+		primitiveIdx -= meshCount;
+
+		const int instanceCount{ static_cast<int>(m_TriangleMeshInstances.size()) };
+		if (primitiveIdx < instanceCount)
+		{
+			const TriangleMeshInstance& instance{ m_TriangleMeshInstances[primitiveIdx] };
+			hit.primitiveType = PrimitiveType::TriangleMeshInstance;
+			hit.primitiveIdx = primitiveIdx;
+			return GeometryUtils::HitTest_TriangleMeshInstance(m_InstancedMeshGeometries[instance.meshIndex], instance, ray, hit);
+		}
+		primitiveIdx -= instanceCount;
+
+		const Triangle& triangle{ m_Triangles[primitiveIdx] };
+		hit.primitiveType = PrimitiveType::Triangle;
+		hit.primitiveIdx = primitiveIdx;
+		hit.triangleIdx = -1;
+		return GeometryUtils::HitTest_Triangle(triangle.v0, triangle.v1 - triangle.v0, triangle.v2 - triangle.v0, triangle.normal, triangle.cullMode,
+			ray, hit.t, hit.u, hit.v);
+	}
+
+	bool Scene::HitTest_TopLevelPrimitive(int primitiveIdx, const Ray& ray, Occluder& occluder) const
+	{
+		primitiveIdx -= static_cast<int>(m_SphereGeometries.size());
+
+		int triangleIdx{};
+		const int meshCount{ static_cast<int>(m_TriangleMeshGeometries.size()) };
+		if (primitiveIdx < meshCount)
+		{
+			if (!GeometryUtils::HitTest_TriangleMesh(m_TriangleMeshGeometries[primitiveIdx], ray, triangleIdx))
+				return false;
+
+			occluder = { PrimitiveType::TriangleMesh, primitiveIdx, triangleIdx };
+			return true;
+		}
+		primitiveIdx -= meshCount;
+
+		const int instanceCount{ static_cast<int>(m_TriangleMeshInstances.size()) };
+		if (primitiveIdx < instanceCount)
+		{
+			const TriangleMeshInstance& instance{ m_TriangleMeshInstances[primitiveIdx] };
+			if (!GeometryUtils::HitTest_TriangleMeshInstance(m_InstancedMeshGeometries[instance.meshIndex], instance, ray, triangleIdx))
+				return false;
+
+			occluder = { PrimitiveType::TriangleMeshInstance, primitiveIdx, triangleIdx };
+			return true;
+		}
+		primitiveIdx -= instanceCount;
+
+		if (!GeometryUtils::HitTest_Triangle(m_Triangles[primitiveIdx], ray))
+			return false;
+
+		occluder = { PrimitiveType::Triangle, primitiveIdx };
+		return true;
+	}
+
+	//Same tests the full query runs on these primitives, so a cached occluder never changes the answer.
+	//Mesh occluders only test their blocking triangle instead of traversing the whole mesh again.
+	bool Scene::HitTest_Occluder(const Occluder& occluder, const Ray& ray) const
+	{
+		switch (occluder.primitiveType)
+		{
+		case PrimitiveType::Sphere:
+			return GeometryUtils::HitTest_Sphere(m_SphereGeometries[occluder.primitiveIdx], ray);
+		case PrimitiveType::Plane:
+			return GeometryUtils::HitTest_Plane(m_PlaneGeometries[occluder.primitiveIdx], ray);
+		case PrimitiveType::TriangleMesh:
+			return GeometryUtils::HitTest_MeshTriangle(m_TriangleMeshGeometries[occluder.primitiveIdx], occluder.triangleIdx, ray);
+		case PrimitiveType::TriangleMeshInstance:
+		{
+			const TriangleMeshInstance& instance{ m_TriangleMeshInstances[occluder.primitiveIdx] };
+			return GeometryUtils::HitTest_MeshTriangle(m_InstancedMeshGeometries[instance.meshIndex], occluder.triangleIdx, GeometryUtils::GetObjectRay(instance, ray));
+		}
+		case PrimitiveType::Triangle:
+			return GeometryUtils::HitTest_Triangle(m_Triangles[occluder.primitiveIdx], ray);
+		default:
+			return false;
+		}
+	}
+
+	void Scene::ResolveHit(const Ray& ray, const HitCandidate& hit, HitRecord& hitRecord) const
+	{
+		hitRecord.didHit = true;
+		hitRecord.t = hit.t;
+		hitRecord.origin = ray.origin + hit.t * ray.direction;
+
+		switch (hit.primitiveType)
+		{
+		case PrimitiveType::Sphere:
+		{
+			const Sphere& sphere{ m_SphereGeometries[hit.primitiveIdx] };
+			hitRecord.normal = Vector3(sphere.origin, hitRecord.origin).Normalized();
+			hitRecord.materialIndex = sphere.materialIndex;
+			break;
+		}
+		case PrimitiveType::Plane:
+		{
+			const Plane& plane{ m_PlaneGeometries[hit.primitiveIdx] };
+			hitRecord.normal = plane.normal;
+			hitRecord.materialIndex = plane.materialIndex;
+			break;
+		}
+		case PrimitiveType::TriangleMesh:
+		{
+			const TriangleMesh& mesh{ m_TriangleMeshGeometries[hit.primitiveIdx] };
+			hitRecord.normal = mesh.transformedNormals[hit.triangleIdx].Normalized();
+			hitRecord.materialIndex = mesh.materialIndex;
+			break;
+		}
+		case PrimitiveType::TriangleMeshInstance:
+		{
+			const TriangleMeshInstance& instance{ m_TriangleMeshInstances[hit.primitiveIdx] };
+			const TriangleMesh& mesh{ m_InstancedMeshGeometries[instance.meshIndex] };
+			hitRecord.normal = instance.normalTransform.TransformVector(mesh.transformedNormals[hit.triangleIdx].Normalized()).Normalized();
+			hitRecord.materialIndex = instance.materialIndex;
+			break;
+		}
+		case PrimitiveType::Triangle:
+		{
+			const Triangle& triangle{ m_Triangles[hit.primitiveIdx] };
+			hitRecord.normal = triangle.normal;
+			hitRecord.materialIndex = triangle.materialIndex;
+			break;
+		}
+		default:
+			hitRecord.didHit = false;
+			break;
 		}
-		return false;
 	}
 
 #pragma region Scene Helpers
@@ -139,6 +596,29 @@ namespace dae {
 		return &m_TriangleMeshGeometries.back();
 	}
 
+	TriangleMesh* Scene::AddInstancedTriangleMesh(TriangleCullMode cullMode)
+	{
+		TriangleMesh m{};
+		m.cullMode = cullMode;
+
+		m_InstancedMeshGeometries.emplace_back(m);
+		return &m_InstancedMeshGeometries.back();
+	}
+
+	TriangleMeshInstance* Scene::AddTriangleMeshInstance(const TriangleMesh* pMesh, const Matrix& transform, unsigned char materialIndex)
+	{
+		assert(pMesh >= m_InstancedMeshGeometries.data() && pMesh < m_InstancedMeshGeometries.data() + m_InstancedMeshGeometries.size()
+			&& "Instances can only refer to meshes added with AddInstancedTriangleMesh");
+
+		TriangleMeshInstance i{};
+		i.meshIndex = static_cast<int>(pMesh - m_InstancedMeshGeometries.data());
+		i.materialIndex = materialIndex;
+		i.SetTransform(transform);
+
+		m_TriangleMeshInstances.emplace_back(i);
+		return &m_TriangleMeshInstances.back();
+	}
+
 	Light* Scene::AddPointLight(const Vector3& origin, float intensity, const ColorRGB& color)
 	{
 		Light l;
@@ -166,6 +646,7 @@ namespace dae {
 	unsigned char Scene::AddMaterial(Material* pMaterial)
 	{
 		m_Materials.push_back(pMaterial);
+		m_MaterialTable.push_back(pMaterial->GetData());
 		return static_cast<unsigned char>(m_Materials.size() - 1);
 	}
 #pragma endregion
@@ -333,7 +814,7 @@ namespace dae {
 
 		////Cube Mesh (temp)
 		pMesh = AddTriangleMesh(TriangleCullMode::BackFaceCulling, matLambert_White);
-		Utils::ParseOBJ("Resources/simple_cube.obj", pMesh->positions, pMesh->normals, pMesh->indices);
+		LoadCachedOBJ("Resources/simple_cube.obj", *pMesh);
 		
 		pMesh->Scale({ 0.7f, 0.7f, 0.7f });
 		pMesh->Translate({ 0.f,1.f,0.f });
@@ -447,7 +928,7 @@ namespace dae {
 
 		////Bunny Mesh
 		pMesh = AddTriangleMesh(TriangleCullMode::BackFaceCulling, matLambert_White);
-		Utils::ParseOBJ("Resources/lowpoly_bunny2.obj", pMesh->positions, pMesh->normals, pMesh->indices);
+		LoadCachedOBJ("Resources/lowpoly_bunny2.obj", *pMesh);
 
 		//pMesh->Scale({ 2.f, 2.f, 2.f });
 		//pMesh->Translate({ 0.f,1.f,-10.f });
@@ -463,4 +944,147 @@ namespace dae {
 	}
 
 #pragma endregion
+
+#pragma region W4_InstancedBunnyScene
+
+	void Scene_W4_InstancedBunnyScene::Initialize()
+	{
+		sceneName = "Instanced Bunny Scene";
+		m_Camera.origin = { 0.f, 3.f, -9.f };
+		m_Camera.fovAngle = 45.f;
+
+		const auto matCT_GrayMediumMetal = AddMaterial(new Material_CookTorrence({ .972f,.960f,.915f }, 1.f, .6f));
+		const auto matCT_GrayRoughPlastic = AddMaterial(new Material_CookTorrence({ .75f,.75f,.75f }, 0.f, 1.f));
+		const auto matLambertPhong_Blue = AddMaterial(new Material_LambertPhong(colors::Blue, 1.f, 1.f, 60.f));
+		const auto matLambert_GrayBlue = AddMaterial(new Material_Lambert({ .49f, .57f, .57f }, 1.f));
+		const auto matLambert_White = AddMaterial(new Material_Lambert(colors::White, 1.f));
+
+		//Plane
+		AddPlane(Vector3{ 0.f, 0.f, 10.f }, Vector3{ 0.f, 0.f, -1.f }, matLambert_GrayBlue); //BACK
+		AddPlane(Vector3{ 0.f, 0.f, 0.f }, Vector3{ 0.f, 1.f, 0.f }, matLambert_GrayBlue); //BOTTOM
+		AddPlane(Vector3{ 0.f, 10.f, 0.f }, Vector3{ 0.f, -1.f, 0.f }, matLambert_GrayBlue); //TOP
+		AddPlane(Vector3{ 5.f, 0.f, 0.f }, Vector3{ -1.f, 0.f, 0.f }, matLambert_GrayBlue); //RIGHT
+		AddPlane(Vector3{ -5.f, 0.f, 0.f }, Vector3{ 1.f, 0.f, 0.f }, matLambert_GrayBlue); //LEFT
+
+		//Bunny Mesh, loaded once and only placed through instances
+		TriangleMesh* pBunny = AddInstancedTriangleMesh(TriangleCullMode::BackFaceCulling);
+		LoadCachedOBJ("Resources/lowpoly_bunny2.obj", *pBunny);
+		pBunny->UpdateTransforms();
+
+		//Instances (scale * rotation * translation, like the mesh transforms)
+		m_pCenterInstance = AddTriangleMeshInstance(pBunny,
+			Matrix::CreateScale(1.5f, 1.5f, 1.5f) * Matrix::CreateTranslation(0.f, 0.f, 1.f), matLambert_White);
+		AddTriangleMeshInstance(pBunny,
+			Matrix::CreateScale(1.4f, .7f, 1.4f) * Matrix::CreateRotationY(PI_DIV_2) * Matrix::CreateTranslation(-3.f, 0.f, 0.f), matCT_GrayMediumMetal);
+		AddTriangleMeshInstance(pBunny,
+			Matrix::CreateScale(.7f, 1.6f, .7f) * Matrix::CreateRotationY(-PI_DIV_2) * Matrix::CreateTranslation(3.f, 0.f, 0.f), matLambertPhong_Blue);
+		m_pTiltedInstance = AddTriangleMeshInstance(pBunny,
+			Matrix::CreateScale(2.5f, 2.5f, 2.5f) * Matrix::CreateTranslation(0.f, 1.f, 6.f), matCT_GrayRoughPlastic);
+		//Upside down under the ceiling
+		AddTriangleMeshInstance(pBunny,
+			Matrix::CreateRotationZ(PI) * Matrix::CreateTranslation(-2.5f, 7.f, 2.f), matLambert_White);
+
+		//Light
+		AddPointLight(Vector3{ 0.f, 5.f, 5.f }, 50.f, ColorRGB{ 1.f, .61f, .45f }); //Backlight
+		AddPointLight(Vector3{ -2.5f, 5.f, -5.f }, 70.f, ColorRGB{ 1.f, .8f, .45f }); //Front Light left
+		AddPointLight(Vector3{ 2.5f, 2.5f, -5.f }, 50.f, ColorRGB{ .34f, .47f, .68f });
+	}
+
+	void Scene_W4_InstancedBunnyScene::Update(Timer* pTimer)
+	{
+		Scene::Update(pTimer);
+
+		//Only the instance matrices change, the shared mesh and its BVH stay untouched
+		const float yawAngle{ PI_DIV_2 * pTimer->GetTotal() };
+		m_pCenterInstance->SetTransform(Matrix::CreateScale(1.5f, 1.5f, 1.5f) * Matrix::CreateRotationY(yawAngle) * Matrix::CreateTranslation(0.f, 0.f, 1.f));
+		m_pTiltedInstance->SetTransform(Matrix::CreateScale(2.5f, 2.5f, 2.5f) * Matrix::CreateRotation(.3f, PI - yawAngle, .2f) * Matrix::CreateTranslation(0.f, 1.f, 6.f));
+	}
+
+#pragma endregion
+
+#pragma region W4_ManyLightsScene
+
+	void Scene_W4_ManyLightsScene::Initialize()
+	{
+		sceneName = "Many Lights Scene";
+		m_Camera.origin = { 0.f, 3.f, -9.f };
+		m_Camera.fovAngle = 45.f;
+
+		const auto matCT_GrayRoughMetal = AddMaterial(new Material_CookTorrence({ .972f,.960f,.915f }, 1.f, 1.f));
+		const auto matCT_GrayMediumMetal = AddMaterial(new Material_CookTorrence({ .972f,.960f,.915f }, 1.f, .6f));
+		const auto matCT_GraySmoothMetal = AddMaterial(new Material_CookTorrence({ .972f,.960f,.915f }, 1.f, .1f));
+		const auto matCT_GrayRoughPlastic = AddMaterial(new Material_CookTorrence({ .75f,.75f,.75f }, 0.f, 1.f));
+		const auto matCT_GrayMediumPlastic = AddMaterial(new Material_CookTorrence({ .75f,.75f,.75f }, 0.f, .6f));
+		const auto matCT_GraySmoothPlastic = AddMaterial(new Material_CookTorrence({ .75f,.75f,.75f }, 0.f, .1f));
+
+		const auto matLambert_GrayBlue = AddMaterial(new Material_Lambert({ .49f, .57f, .57f }, 1.f));
+
+		//Plane
+		AddPlane(Vector3{ 0.f, 0.f, 10.f }, Vector3{ 0.f, 0.f, -1.f }, matLambert_GrayBlue); //BACK
+		AddPlane(Vector3{ 0.f, 0.f, 0.f }, Vector3{ 0.f, 1.f, 0.f }, matLambert_GrayBlue); //BOTTOM
+		AddPlane(Vector3{ 0.f, 10.f, 0.f }, Vector3{ 0.f, -1.f, 0.f }, matLambert_GrayBlue); //TOP
+		AddPlane(Vector3{ 5.f, 0.f, 0.f }, Vector3{ -1.f, 0.f, 0.f }, matLambert_GrayBlue); //RIGHT
+		AddPlane(Vector3{ -5.f, 0.f, 0.f }, Vector3{ 1.f, 0.f, 0.f }, matLambert_GrayBlue); //LEFT
+
+		//Spheres
+		AddSphere({ -1.75f, 1.f, 0.f }, 0.75f, matCT_GrayRoughMetal);
+		AddSphere({ 0.f, 1.f, 0.f }, 0.75f, matCT_GrayMediumMetal);
+		AddSphere({ 1.75f, 1.f, 0.f }, 0.75f, matCT_GraySmoothMetal);
+		AddSphere({ -1.75f, 3.f, 0.f }, 0.75f, matCT_GrayRoughPlastic);
+		AddSphere({ 0.f, 3.f, 0.f }, 0.75f, matCT_GrayMediumPlastic);
+		AddSphere({ 1.75f, 3.f, 0.f }, 0.75f, matCT_GraySmoothPlastic);
+
+		//Lights, a 16x8 grid under the ceiling and one in front of the spheres, the hue walks around the color wheel
+		constexpr int GridWidth{ 16 };
+		constexpr int GridDepth{ 8 };
+		for (int lightIdx{}; lightIdx < 2 * GridWidth * GridDepth; ++lightIdx)
+		{
+			const float column{ static_cast<float>(lightIdx % GridWidth) / (GridWidth - 1) };
+			const float row{ static_cast<float>(lightIdx / GridWidth % GridDepth) / (GridDepth - 1) };
+			const Vector3 origin{ lightIdx < GridWidth * GridDepth
+				? Vector3{ -4.5f + 9.f * column, 9.5f, -4.f + 13.f * row }
+				: Vector3{ -4.5f + 9.f * column, .5f + 8.f * row, -4.f } };
+
+			const float hue{ static_cast<float>(lightIdx) / (2 * GridWidth * GridDepth) * 2.f * PI };
+			const ColorRGB color{ .6f + .4f * cosf(hue), .6f + .4f * cosf(hue - 2.f * PI / 3.f), .6f + .4f * cosf(hue + 2.f * PI / 3.f) };
+			AddPointLight(origin, 1.5f, color);
+		}
+	}
+
+#pragma endregion
+
+#pragma region Scene Factory
+	const std::vector<std::string>& GetSceneNames()
+	{
+		static const std::vector<std::string> sceneNames{ "W1", "W2", "W3", "W3_TestScene", "W4_TestScene", "W4_ReferenceScene", "W4_BunnyScene", "W4_InstancedBunnyScene", "W4_ManyLightsScene" };
+		return sceneNames;
+	}
+
+	Scene* CreateScene(const std::string& sceneName)
+	{
+		//Accept both "W4_ReferenceScene" and the class name "Scene_W4_ReferenceScene"
+		const std::string name{ sceneName.rfind("Scene_", 0) == 0 ? sceneName.substr(6) : sceneName };
+
+		if (name == "W1")
+			return new Scene_W1();
+		if (name == "W2")
+			return new Scene_W2();
+		if (name == "W3")
+			return new Scene_W3();
+		if (name == "W3_TestScene")
+			return new Scene_W3_TestScene();
+		if (name == "W4_TestScene")
+			return new Scene_W4_TestScene();
+		if (name == "W4_ReferenceScene")
+			return new Scene_W4_ReferenceScene();
+		if (name == "W4_BunnyScene")
+			return new Scene_W4_BunnyScene();
+		if (name == "W4_InstancedBunnyScene")
+			return new Scene_W4_InstancedBunnyScene();
+		if (name == "W4_ManyLightsScene")
+			return new Scene_W4_ManyLightsScene();
+
+		return nullptr;
+	}
+#pragma endregion
 }
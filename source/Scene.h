@@ -5,6 +5,9 @@
 #include "Math.h"
 #include "DataTypes.h"
 #include "Camera.h"
+#include "SphereSoA.h"
+#include "LightTree.h"
+#include "Material.h"
 
 namespace dae
 {
@@ -35,12 +38,30 @@ namespace dae
 
 		Camera& GetCamera() { return m_Camera; }
 		void GetClosestHit(const Ray& ray, HitRecord& closestHit) const;
+		//Traces the packet as a whole while its rays stay coherent, closestHits holds one record per lane
+		void GetClosestHit(RayPacket& packet, HitRecord* closestHits) const;
 		bool DoesHit(const Ray& ray) const;
+		//Shadow ray query, tests the primitive that blocked the previous ray towards the same light first.
+		//occluder is replaced by the primitive that blocks this ray and kept when nothing does, start with an empty one every tile.
+		bool DoesHit(const Ray& ray, Occluder& occluder) const;
+
+		//Brute force versions that test every primitive without any acceleration structure, the accelerated queries have to match them
+		void GetClosestHitReference(const Ray& ray, HitRecord& closestHit) const;
+		bool DoesHitReference(const Ray& ray) const;
+
+		//Rebuilds the top level structure when objects were added or moved, call before tracing a frame
+		void UpdateAccelerationStructure();
+		//Changes whenever UpdateAccelerationStructure noticed added objects or a changed mesh or instance transform
+		uint32_t GetGeometryVersion() const { return m_GeometryVersion; }
 
 		const std::vector<Plane>& GetPlaneGeometries() const { return m_PlaneGeometries; }
 		const std::vector<Sphere>& GetSphereGeometries() const { return m_SphereGeometries; }
 		const std::vector<Light>& GetLights() const { return m_Lights; }
-		const std::vector<Material*> GetMaterials() const { return m_Materials; }
+		//Point lights ranked for light sampling, kept up to date by UpdateAccelerationStructure
+		const LightTree& GetLightTree() const { return m_LightTree; }
+		const std::vector<Material*>& GetMaterials() const { return m_Materials; }
+		//Shading reads materials from here, one entry per material index
+		const std::vector<MaterialData>& GetMaterialTable() const { return m_MaterialTable; }
 
 	protected:
 		std::string	sceneName;
@@ -48,17 +69,59 @@ namespace dae
 		std::vector<Plane> m_PlaneGeometries{};
 		std::vector<Sphere> m_SphereGeometries{};
 		std::vector<TriangleMesh> m_TriangleMeshGeometries{};
+		std::vector<TriangleMesh> m_InstancedMeshGeometries{};
+		std::vector<TriangleMeshInstance> m_TriangleMeshInstances{};
 		std::vector<Light> m_Lights{};
+		LightTree m_LightTree{};
 		std::vector<Material*> m_Materials{};
+		std::vector<MaterialData> m_MaterialTable{};
 
 		//Temp (single triangle testing)
 		std::vector<Triangle> m_Triangles{};
 
 		Camera m_Camera{};
 
+		//Top level structure over the bounds of spheres, whole meshes, mesh instances and single triangles (in that primitive order),
+		//every mesh keeps its own bottom level BVH. Infinite planes can't be bounded and stay in their own list.
+		BVH m_TopLevelBVH{};
+		std::vector<AABB> m_TopLevelBounds{};
+		std::vector<AABB> m_TopLevelPreviousBounds{};
+
+		uint32_t m_GeometryVersion{};
+		uint64_t m_PreviousGeometryState{};
+
+		//Spheres of every top level leaf copied into one padded SoA run, indexed by top level node
+		struct SphereRun
+		{
+			int first{};
+			int count{};
+		};
+		SphereSoA m_SphereSoA{};
+		std::vector<SphereRun> m_LeafSphereRuns{};
+
+		static constexpr int TopLevelLeafSize{ 2 * SphereSoA::Width };
+
+		void UpdateSphereSoA();
+
+		//Top level primitive indices with every leaf sorted from most to least likely occluder, what shadow rays test in
+		std::vector<int> m_TopLevelOcclusionOrder{};
+
+		void UpdateOcclusionOrder();
+
+		//Meshes, instances and triangles only, spheres go through the SoA runs
+		bool HitTest_TopLevelPrimitive(int primitiveIdx, const Ray& ray, HitCandidate& hit) const;
+		bool HitTest_TopLevelPrimitive(int primitiveIdx, const Ray& ray, Occluder& occluder) const;
+		bool HitTest_Occluder(const Occluder& occluder, const Ray& ray) const;
+		//Builds the surface data of the hit record for the final closest hit, ray has to be the ray the candidate was found with
+		void ResolveHit(const Ray& ray, const HitCandidate& hit, HitRecord& hitRecord) const;
+		bool HitTest_InstanceReference(const TriangleMeshInstance& instance, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord) const;
+
 		Sphere* AddSphere(const Vector3& origin, float radius, unsigned char materialIndex = 0);
 		Plane* AddPlane(const Vector3& origin, const Vector3& normal, unsigned char materialIndex = 0);
 		TriangleMesh* AddTriangleMesh(TriangleCullMode cullMode, unsigned char materialIndex = 0);
+		//Shared mesh that is only drawn through instances, keep its own transform at identity
+		TriangleMesh* AddInstancedTriangleMesh(TriangleCullMode cullMode);
+		TriangleMeshInstance* AddTriangleMeshInstance(const TriangleMesh* pMesh, const Matrix& transform, unsigned char materialIndex = 0);
 
 		Light* AddPointLight(const Vector3& origin, float intensity, const ColorRGB& color);
 		Light* AddDirectionalLight(const Vector3& direction, float intensity, const ColorRGB& color);
@@ -174,4 +237,43 @@ namespace dae
 	private:
 		TriangleMesh* pMesh{ nullptr };
 	};
+
+	//One bunny mesh drawn through rotated and (non-uniformly) scaled instances, two of them keep turning
+	class Scene_W4_InstancedBunnyScene final : public Scene
+	{
+	public:
+		Scene_W4_InstancedBunnyScene() = default;
+		~Scene_W4_InstancedBunnyScene() override = default;
+
+		Scene_W4_InstancedBunnyScene(const Scene_W4_InstancedBunnyScene&) = delete;
+		Scene_W4_InstancedBunnyScene(Scene_W4_InstancedBunnyScene&&) noexcept = delete;
+		Scene_W4_InstancedBunnyScene& operator=(const Scene_W4_InstancedBunnyScene&) = delete;
+		Scene_W4_InstancedBunnyScene& operator=(Scene_W4_InstancedBunnyScene&&) noexcept = delete;
+
+		void Initialize() override;
+		void Update(Timer* pTimer) override;
+
+	private:
+		TriangleMeshInstance* m_pCenterInstance{ nullptr };
+		TriangleMeshInstance* m_pTiltedInstance{ nullptr };
+	};
+
+	//Reference scene spheres lit by hundreds of small colored point lights, what light sampling is measured on
+	class Scene_W4_ManyLightsScene final : public Scene
+	{
+	public:
+		Scene_W4_ManyLightsScene() = default;
+		~Scene_W4_ManyLightsScene() override = default;
+
+		Scene_W4_ManyLightsScene(const Scene_W4_ManyLightsScene&) = delete;
+		Scene_W4_ManyLightsScene(Scene_W4_ManyLightsScene&&) noexcept = delete;
+		Scene_W4_ManyLightsScene& operator=(const Scene_W4_ManyLightsScene&) = delete;
+		Scene_W4_ManyLightsScene& operator=(Scene_W4_ManyLightsScene&&) noexcept = delete;
+
+		void Initialize() override;
+	};
+
+	//Scene lookup by name for command line selection, returns nullptr for an unknown name
+	const std::vector<std::string>& GetSceneNames();
+	Scene* CreateScene(const std::string& sceneName);
 }
@@ -0,0 +1,185 @@
+#pragma once
+#include <cfloat>
+#include <vector>
+
+#if defined(__AVX2__) || defined(_M_X64) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "Math.h"
+#include "DataTypes.h"
+
+namespace dae
+{
+	//Spheres stored as separate component arrays, so one ray can be tested against a whole SIMD register of spheres.
+	//Spheres are added in runs (one run per top level leaf) and every run is padded to a multiple of the SIMD width.
+	struct SphereSoA
+	{
+#if defined(__AVX2__)
+		static constexpr int Width{ 8 };
+#elif defined(_M_X64) || defined(__SSE2__)
+		static constexpr int Width{ 4 };
+#else
+		static constexpr int Width{ 1 };
+#endif
+
+		std::vector<float> originX{};
+		std::vector<float> originY{};
+		std::vector<float> originZ{};
+		std::vector<float> radiusSquared{};
+		std::vector<int> sphereIndices{}; //index in the scene sphere list, -1 for padding
+
+		void Clear()
+		{
+			originX.clear();
+			originY.clear();
+			originZ.clear();
+			radiusSquared.clear();
+			sphereIndices.clear();
+		}
+
+		int GetSize() const { return static_cast<int>(sphereIndices.size()); }
+
+		void Add(const Sphere& sphere, int sphereIdx)
+		{
+			originX.push_back(sphere.origin.x);
+			originY.push_back(sphere.origin.y);
+			originZ.push_back(sphere.origin.z);
+			radiusSquared.push_back(sphere.radius * sphere.radius);
+			sphereIndices.push_back(sphereIdx);
+		}
+
+		//Padding lanes get a negative squared radius so they can never be hit
+		void PadToWidth()
+		{
+			while (GetSize() % Width != 0)
+			{
+				originX.push_back(0.f);
+				originY.push_back(0.f);
+				originZ.push_back(0.f);
+				radiusSquared.push_back(-1.f);
+				sphereIndices.push_back(-1);
+			}
+		}
+	};
+
+	namespace GeometryUtils
+	{
+		/**
+		 * \brief Intersects a ray with a padded run of spheres, same hit rules as HitTest_Sphere
+		 * \param first first slot of the run, multiple of SphereSoA::Width
+		 * \param count number of slots in the run, multiple of SphereSoA::Width
+		 * \param t distance to the closest hit, only written when a sphere closer than tMax is hit
+		 * \param anyHit stop at the first sphere that is hit (shadow rays)
+		 * \return slot of the closest hit, -1 if no sphere is hit
+		 */
+		inline int HitTest_Spheres(const SphereSoA& spheres, int first, int count, const Ray& ray, float tMax, float& t, bool anyHit = false)
+		{
+			int hitSlot{ -1 };
+			const int end{ first + count };
+
+#if defined(__AVX2__)
+			const __m256 rayOriginX{ _mm256_set1_ps(ray.origin.x) };
+			const __m256 rayOriginY{ _mm256_set1_ps(ray.origin.y) };
+			const __m256 rayOriginZ{ _mm256_set1_ps(ray.origin.z) };
+			const __m256 rayDirectionX{ _mm256_set1_ps(ray.direction.x) };
+			const __m256 rayDirectionY{ _mm256_set1_ps(ray.direction.y) };
+			const __m256 rayDirectionZ{ _mm256_set1_ps(ray.direction.z) };
+			const __m256 rayMin{ _mm256_set1_ps(ray.min) };
+			const __m256 zero{ _mm256_setzero_ps() };
+
+			for (int slot{ first }; slot < end; slot += SphereSoA::Width)
+			{
+				const __m256 toSphereX{ _mm256_sub_ps(_mm256_loadu_ps(&spheres.originX[slot]), rayOriginX) };
+				const __m256 toSphereY{ _mm256_sub_ps(_mm256_loadu_ps(&spheres.originY[slot]), rayOriginY) };
+				const __m256 toSphereZ{ _mm256_sub_ps(_mm256_loadu_ps(&spheres.originZ[slot]), rayOriginZ) };
+				const __m256 radiusSquared{ _mm256_loadu_ps(&spheres.radiusSquared[slot]) };
+
+				//No fused multiply-add, the distance is the distance of the hit and has to match the single ray and packet tests bit for bit
+				const __m256 side{ _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(toSphereX, rayDirectionX), _mm256_mul_ps(toSphereY, rayDirectionY)), _mm256_mul_ps(toSphereZ, rayDirectionZ)) };
+				const __m256 hypothenuseSquared{ _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(toSphereX, toSphereX), _mm256_mul_ps(toSphereY, toSphereY)), _mm256_mul_ps(toSphereZ, toSphereZ)) };
+				const __m256 distanceToRaySquared{ _mm256_sub_ps(hypothenuseSquared, _mm256_mul_ps(side, side)) };
+
+				const __m256 distance{ _mm256_sub_ps(side, _mm256_sqrt_ps(_mm256_max_ps(_mm256_sub_ps(radiusSquared, distanceToRaySquared), zero))) };
+
+				__m256 mask{ _mm256_cmp_ps(distanceToRaySquared, radiusSquared, _CMP_LT_OQ) };
+				mask = _mm256_and_ps(mask, _mm256_cmp_ps(distance, rayMin, _CMP_GE_OQ));
+				mask = _mm256_and_ps(mask, _mm256_cmp_ps(distance, _mm256_set1_ps(tMax), _CMP_LE_OQ));
+
+				int laneMask{ _mm256_movemask_ps(mask) };
+				if (laneMask == 0)
+					continue;
+
+				alignas(32) float distances[SphereSoA::Width];
+				_mm256_store_ps(distances, distance);
+#elif defined(_M_X64) || defined(__SSE2__)
+			const __m128 rayOriginX{ _mm_set1_ps(ray.origin.x) };
+			const __m128 rayOriginY{ _mm_set1_ps(ray.origin.y) };
+			const __m128 rayOriginZ{ _mm_set1_ps(ray.origin.z) };
+			const __m128 rayDirectionX{ _mm_set1_ps(ray.direction.x) };
+			const __m128 rayDirectionY{ _mm_set1_ps(ray.direction.y) };
+			const __m128 rayDirectionZ{ _mm_set1_ps(ray.direction.z) };
+			const __m128 rayMin{ _mm_set1_ps(ray.min) };
+			const __m128 zero{ _mm_setzero_ps() };
+
+			for (int slot{ first }; slot < end; slot += SphereSoA::Width)
+			{
+				const __m128 toSphereX{ _mm_sub_ps(_mm_loadu_ps(&spheres.originX[slot]), rayOriginX) };
+				const __m128 toSphereY{ _mm_sub_ps(_mm_loadu_ps(&spheres.originY[slot]), rayOriginY) };
+				const __m128 toSphereZ{ _mm_sub_ps(_mm_loadu_ps(&spheres.originZ[slot]), rayOriginZ) };
+				const __m128 radiusSquared{ _mm_loadu_ps(&spheres.radiusSquared[slot]) };
+
+				const __m128 side{ _mm_add_ps(_mm_add_ps(_mm_mul_ps(toSphereX, rayDirectionX), _mm_mul_ps(toSphereY, rayDirectionY)), _mm_mul_ps(toSphereZ, rayDirectionZ)) };
+				const __m128 hypothenuseSquared{ _mm_add_ps(_mm_add_ps(_mm_mul_ps(toSphereX, toSphereX), _mm_mul_ps(toSphereY, toSphereY)), _mm_mul_ps(toSphereZ, toSphereZ)) };
+				const __m128 distanceToRaySquared{ _mm_sub_ps(hypothenuseSquared, _mm_mul_ps(side, side)) };
+
+				const __m128 distance{ _mm_sub_ps(side, _mm_sqrt_ps(_mm_max_ps(_mm_sub_ps(radiusSquared, distanceToRaySquared), zero))) };
+
+				__m128 mask{ _mm_cmplt_ps(distanceToRaySquared, radiusSquared) };
+				mask = _mm_and_ps(mask, _mm_cmpge_ps(distance, rayMin));
+				mask = _mm_and_ps(mask, _mm_cmple_ps(distance, _mm_set1_ps(tMax)));
+
+				int laneMask{ _mm_movemask_ps(mask) };
+				if (laneMask == 0)
+					continue;
+
+				alignas(16) float distances[SphereSoA::Width];
+				_mm_store_ps(distances, distance);
+#else
+			for (int slot{ first }; slot < end; ++slot)
+			{
+				const Vector3 toSphere{ spheres.originX[slot] - ray.origin.x, spheres.originY[slot] - ray.origin.y, spheres.originZ[slot] - ray.origin.z };
+				const float side{ Vector3::Dot(toSphere, ray.direction) };
+				const float distanceToRaySquared{ toSphere.SqrMagnitude() - side * side };
+				if (distanceToRaySquared >= spheres.radiusSquared[slot])
+					continue;
+
+				float distances[SphereSoA::Width]{ side - sqrtf(spheres.radiusSquared[slot] - distanceToRaySquared) };
+				int laneMask{ distances[0] >= ray.min && distances[0] <= tMax ? 1 : 0 };
+				if (laneMask == 0)
+					continue;
+#endif
+				//Few lanes hit at once, resolve the closest one in scalar code
+				while (laneMask != 0)
+				{
+					int lane{};
+					while ((laneMask & (1 << lane)) == 0)
+						++lane;
+					laneMask &= ~(1 << lane);
+
+					if (distances[lane] <= tMax)
+					{
+						tMax = distances[lane];
+						t = distances[lane];
+						hitSlot = slot + lane;
+
+						if (anyHit)
+							return hitSlot;
+					}
+				}
+			}
+
+			return hitSlot;
+		}
+	}
+}
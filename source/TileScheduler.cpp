@@ -0,0 +1,118 @@
+#include "TileScheduler.h"
+
+#include <algorithm>
+
+using namespace dae;
+
+TileScheduler::TileScheduler(int threadCount)
+{
+	if (threadCount <= 0)
+		threadCount = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+
+	m_Ranges = std::vector<TileRange>(threadCount);
+
+	//The calling thread works as thread 0, so only spawn the remaining ones
+	m_Workers.reserve(threadCount - 1);
+	for (int threadIdx{ 1 }; threadIdx < threadCount; ++threadIdx)
+	{
+		m_Workers.emplace_back(&TileScheduler::WorkerLoop, this, threadIdx);
+	}
+}
+
+TileScheduler::~TileScheduler()
+{
+	m_IsRunning.store(false);
+	m_FrameGeneration.fetch_add(1, std::memory_order_release);
+	m_FrameGeneration.notify_all();
+
+	for (auto& worker : m_Workers)
+	{
+		worker.join();
+	}
+}
+
+void TileScheduler::SetFrameSize(int width, int height)
+{
+	m_Tiles.clear();
+	for (int y{}; y < height; y += TileSize)
+	{
+		for (int x{}; x < width; x += TileSize)
+		{
+			m_Tiles.push_back({ x, y, std::min(x + TileSize, width), std::min(y + TileSize, height) });
+		}
+	}
+}
+
+void TileScheduler::Dispatch()
+{
+	const int threadCount{ GetThreadCount() };
+	const int tileCount{ GetTileCount() };
+
+	//Hand every thread a contiguous block of tiles, neighbouring tiles share more of the scene
+	for (int threadIdx{}; threadIdx < threadCount; ++threadIdx)
+	{
+		m_Ranges[threadIdx].next.store(tileCount * threadIdx / threadCount, std::memory_order_relaxed);
+		m_Ranges[threadIdx].end = tileCount * (threadIdx + 1) / threadCount;
+	}
+
+	m_ActiveWorkers.store(static_cast<int>(m_Workers.size()), std::memory_order_relaxed);
+	m_FrameGeneration.fetch_add(1, std::memory_order_release);
+	m_FrameGeneration.notify_all();
+
+	ProcessTiles(0);
+
+	//Wait for the workers that are still finishing (or stealing) tiles
+	int activeWorkers{ m_ActiveWorkers.load(std::memory_order_acquire) };
+	while (activeWorkers != 0)
+	{
+		m_ActiveWorkers.wait(activeWorkers, std::memory_order_acquire);
+		activeWorkers = m_ActiveWorkers.load(std::memory_order_acquire);
+	}
+}
+
+void TileScheduler::WorkerLoop(int threadIdx)
+{
+	uint32_t seenGeneration{};
+	while (true)
+	{
+		m_FrameGeneration.wait(seenGeneration, std::memory_order_acquire);
+		seenGeneration = m_FrameGeneration.load(std::memory_order_acquire);
+
+		if (!m_IsRunning.load())
+			return;
+
+		ProcessTiles(threadIdx);
+
+		if (m_ActiveWorkers.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			m_ActiveWorkers.notify_one();
+	}
+}
+
+void TileScheduler::ProcessTiles(int threadIdx)
+{
+	const int threadCount{ GetThreadCount() };
+
+	//Drain own range first, then steal from the others
+	for (int offset{}; offset < threadCount; ++offset)
+	{
+		const int rangeIdx{ (threadIdx + offset) % threadCount };
+
+		int tileIdx{};
+		while (PopTile(rangeIdx, tileIdx))
+		{
+			m_pTask(m_pTaskContext, m_Tiles[tileIdx], threadIdx);
+		}
+	}
+}
+
+bool TileScheduler::PopTile(int rangeIdx, int& tileIdx)
+{
+	TileRange& range{ m_Ranges[rangeIdx] };
+
+	//Cheap check first so drained ranges don't get hammered with atomic increments
+	if (range.next.load(std::memory_order_relaxed) >= range.end)
+		return false;
+
+	tileIdx = range.next.fetch_add(1, std::memory_order_relaxed);
+	return tileIdx < range.end;
+}
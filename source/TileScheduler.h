@@ -0,0 +1,79 @@
+#pragma once
+
+//Standard includes
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+namespace dae
+{
+	struct Tile
+	{
+		int startX{};
+		int startY{};
+		int endX{};
+		int endY{};
+	};
+
+	//Persistent worker pool that splits the framebuffer into fixed-size tiles.
+	//Every worker owns a contiguous range of tiles and steals from the other ranges once its own is drained,
+	//so the only shared state on the hot path are the per-range atomic counters.
+	class TileScheduler final
+	{
+	public:
+		explicit TileScheduler(int threadCount = 0);
+		~TileScheduler();
+
+		TileScheduler(const TileScheduler&) = delete;
+		TileScheduler(TileScheduler&&) noexcept = delete;
+		TileScheduler& operator=(const TileScheduler&) = delete;
+		TileScheduler& operator=(TileScheduler&&) noexcept = delete;
+
+		void SetFrameSize(int width, int height);
+		int GetThreadCount() const { return static_cast<int>(m_Workers.size()) + 1; }
+		int GetTileCount() const { return static_cast<int>(m_Tiles.size()); }
+		const Tile& GetTile(int tileIdx) const { return m_Tiles[tileIdx]; }
+
+		/**
+		 * \brief Runs func(tile, threadIdx) for every tile of the frame, blocks until all tiles are done
+		 * \param func callable invoked once per tile, the calling thread participates as thread 0
+		 */
+		template<typename TileFunc>
+		void Run(const TileFunc& func)
+		{
+			m_pTaskContext = &func;
+			m_pTask = [](const void* pContext, const Tile& tile, int threadIdx)
+			{
+				(*static_cast<const TileFunc*>(pContext))(tile, threadIdx);
+			};
+			Dispatch();
+		}
+
+		static constexpr int TileSize{ 32 };
+
+	private:
+		//Own cache line per range to avoid false sharing between workers
+		struct alignas(64) TileRange
+		{
+			std::atomic<int> next{};
+			int end{};
+		};
+
+		std::vector<Tile> m_Tiles{};
+		std::vector<std::thread> m_Workers{};
+		std::vector<TileRange> m_Ranges{};
+
+		const void* m_pTaskContext{ nullptr };
+		void (*m_pTask)(const void*, const Tile&, int) { nullptr };
+
+		std::atomic<uint32_t> m_FrameGeneration{};
+		std::atomic<int> m_ActiveWorkers{};
+		std::atomic<bool> m_IsRunning{ true };
+
+		void Dispatch();
+		void WorkerLoop(int threadIdx);
+		void ProcessTiles(int threadIdx);
+		bool PopTile(int rangeIdx, int& tileIdx);
+	};
+}
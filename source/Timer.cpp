@@ -47,6 +47,14 @@ void Timer::Update()
 	const uint64_t currentTime = SDL_GetPerformanceCounter();
 	m_CurrentTime = currentTime;
 
+	if (m_FixedTimeStep > 0.0f)
+	{
+		m_PreviousTime = m_CurrentTime;
+		m_ElapsedTime = m_FixedTimeStep;
+		m_TotalTime += m_FixedTimeStep;
+		return;
+	}
+
 	m_ElapsedTime = (float)((m_CurrentTime - m_PreviousTime) * m_SecondsPerCount);
 	m_PreviousTime = m_CurrentTime;
 
@@ -21,6 +21,9 @@ namespace dae
 		void Update();
 		void Stop();
 
+		//Advance by a fixed step every Update instead of the measured time, makes offline renders deterministic
+		void SetFixedTimeStep(float timeStep) { m_FixedTimeStep = timeStep; };
+
 		uint32_t GetFPS() const { return m_FPS; };
 		float GetdFPS() const { return m_dFPS; };
 		float GetElapsed() const { return m_ElapsedTime; };
@@ -43,6 +46,7 @@ namespace dae
 		float m_SecondsPerCount = 0.0f;
 		float m_ElapsedUpperBound = 0.03f;
 		float m_FPSTimer = 0.0f;
+		float m_FixedTimeStep = 0.0f;
 
 		bool m_IsStopped = true;
 		bool m_ForceElapsedUpperBound = false;
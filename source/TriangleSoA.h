@@ -0,0 +1,122 @@
+#pragma once
+#include <vector>
+
+#include "Math.h"
+#include "BVH.h"
+
+namespace dae
+{
+	//Intersection data of a mesh stored as separate component arrays, so one ray can be tested against a whole SIMD register of triangles.
+	//The triangles of every BVH leaf are stored as one run, padded to a multiple of the SIMD width.
+	struct TriangleSoA
+	{
+#if defined(__AVX2__)
+		static constexpr int Width{ 8 };
+#elif defined(_M_X64) || defined(__SSE2__)
+		static constexpr int Width{ 4 };
+#else
+		static constexpr int Width{ 1 };
+#endif
+
+		struct LeafRun
+		{
+			int first{};
+			int count{}; //multiple of Width
+		};
+
+		std::vector<float> v0X{};
+		std::vector<float> v0Y{};
+		std::vector<float> v0Z{};
+		std::vector<float> edge0X{}; //v1 - v0
+		std::vector<float> edge0Y{};
+		std::vector<float> edge0Z{};
+		std::vector<float> edge1X{}; //v2 - v0
+		std::vector<float> edge1Y{};
+		std::vector<float> edge1Z{};
+		std::vector<float> normalX{}; //normalized
+		std::vector<float> normalY{};
+		std::vector<float> normalZ{};
+		std::vector<int> triangleIndices{}; //triangle number in the mesh, -1 for padding
+
+		std::vector<LeafRun> leafRuns{}; //indexed by BVH node, empty for inner nodes
+
+		int GetSize() const { return static_cast<int>(triangleIndices.size()); }
+
+		Vector3 GetV0(int slot) const { return { v0X[slot], v0Y[slot], v0Z[slot] }; }
+		Vector3 GetEdge0(int slot) const { return { edge0X[slot], edge0Y[slot], edge0Z[slot] }; }
+		Vector3 GetEdge1(int slot) const { return { edge1X[slot], edge1Y[slot], edge1Z[slot] }; }
+		Vector3 GetNormal(int slot) const { return { normalX[slot], normalY[slot], normalZ[slot] }; }
+
+		/**
+		 * \brief Recalculates all runs for the leaves of bvh
+		 * \param normals one normal per triangle, normalized here
+		 */
+		void Update(const std::vector<Vector3>& positions, const std::vector<Vector3>& normals, const std::vector<int>& indices, const BVH& bvh)
+		{
+			const std::vector<BVHNode>& nodes{ bvh.GetNodes() };
+			const std::vector<int>& primitiveIndices{ bvh.GetPrimitiveIndices() };
+
+			//Sizes stay the same as long as the tree isn't rebuilt, so updating a moving mesh never allocates
+			leafRuns.resize(nodes.size());
+			int slotCount{};
+			for (size_t nodeIdx{}; nodeIdx < nodes.size(); ++nodeIdx)
+			{
+				const int primitiveCount{ nodes[nodeIdx].IsLeaf() ? nodes[nodeIdx].primitiveCount : 0 };
+				leafRuns[nodeIdx] = { slotCount, (primitiveCount + Width - 1) / Width * Width };
+				slotCount += leafRuns[nodeIdx].count;
+			}
+
+			for (std::vector<float>* pComponent : { &v0X, &v0Y, &v0Z, &edge0X, &edge0Y, &edge0Z, &edge1X, &edge1Y, &edge1Z, &normalX, &normalY, &normalZ })
+			{
+				pComponent->resize(slotCount);
+			}
+			triangleIndices.resize(slotCount);
+
+			for (size_t nodeIdx{}; nodeIdx < nodes.size(); ++nodeIdx)
+			{
+				const BVHNode& node{ nodes[nodeIdx] };
+				const LeafRun& run{ leafRuns[nodeIdx] };
+				for (int runIdx{}; runIdx < run.count; ++runIdx)
+				{
+					const int slot{ run.first + runIdx };
+					if (runIdx >= node.primitiveCount)
+					{
+						SetPadding(slot);
+						continue;
+					}
+
+					const int triangleNr{ primitiveIndices[node.leftFirst + runIdx] };
+					const Vector3& v0{ positions[indices[triangleNr * 3]] };
+					const Vector3 edge0{ positions[indices[triangleNr * 3 + 1]] - v0 };
+					const Vector3 edge1{ positions[indices[triangleNr * 3 + 2]] - v0 };
+					const Vector3 normal{ normals[triangleNr].Normalized() };
+
+					v0X[slot] = v0.x;
+					v0Y[slot] = v0.y;
+					v0Z[slot] = v0.z;
+					edge0X[slot] = edge0.x;
+					edge0Y[slot] = edge0.y;
+					edge0Z[slot] = edge0.z;
+					edge1X[slot] = edge1.x;
+					edge1Y[slot] = edge1.y;
+					edge1Z[slot] = edge1.z;
+					normalX[slot] = normal.x;
+					normalY[slot] = normal.y;
+					normalZ[slot] = normal.z;
+					triangleIndices[slot] = triangleNr;
+				}
+			}
+		}
+
+	private:
+		//Padding lanes are degenerate and have no normal, so they can never be hit
+		void SetPadding(int slot)
+		{
+			for (std::vector<float>* pComponent : { &v0X, &v0Y, &v0Z, &edge0X, &edge0Y, &edge0Z, &edge1X, &edge1Y, &edge1Z, &normalX, &normalY, &normalZ })
+			{
+				(*pComponent)[slot] = 0.f;
+			}
+			triangleIndices[slot] = -1;
+		}
+	};
+}
@@ -1,8 +1,9 @@
 #pragma once
+#include <bit>
 #include <cassert>
-#include <fstream>
 #include "Math.h"
 #include "DataTypes.h"
+#include "ObjLoader.h"
 
 namespace dae
 {
@@ -52,10 +53,16 @@ namespace dae
 #pragma endregion
 #pragma region Plane HitTest
 		//PLANE HIT-TESTS
+		inline bool HitTest_Plane(const Plane& plane, const Ray& ray, float& t)
+		{
+			t = Vector3::Dot(Vector3{ ray.origin, plane.origin }, plane.normal) / Vector3::Dot(ray.direction, plane.normal);
+			return t >= ray.min && t <= ray.max;
+		}
+
 		inline bool HitTest_Plane(const Plane& plane, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
 		{
-			const float distance{ Vector3::Dot(Vector3{ ray.origin, plane.origin }, plane.normal) / Vector3::Dot(ray.direction, plane.normal) };
-			if (distance >= ray.min && distance <= ray.max) {
+			float distance{};
+			if (HitTest_Plane(plane, ray, distance)) {
 				hitRecord.didHit = true;
 				if (ignoreHitRecord) {
 					return true;
@@ -79,19 +86,23 @@ namespace dae
 #pragma endregion
 #pragma region Triangle HitTest
 		//TRIANGLE HIT-TESTS
-		inline bool HitTest_Triangle(const Triangle& triangle, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
+		/**
+		 * \brief Moller-Trumbore test against the triangle v0, v0 + edge0, v0 + edge1
+		 * \param normal normalized face normal, only used for culling
+		 * \param t distance to the hit, only valid when true is returned
+		 * \param u, v barycentric weights of v0 + edge0 and v0 + edge1 at the hit, only valid when true is returned
+		 * \param ignoreHitRecord shadow ray, these cull the opposite side
+		 */
+		inline bool HitTest_Triangle(const Vector3& v0, const Vector3& edge0, const Vector3& edge1, const Vector3& normal, TriangleCullMode cullMode,
+			const Ray& ray, float& t, float& u, float& v, bool ignoreHitRecord = false)
 		{
-			//todo W5
-			//assert(false && "No Implemented Yet!");
-			const Vector3 a = triangle.v1 - triangle.v0;
-			const Vector3 b = triangle.v2 - triangle.v0;
-			const float dotRayNormal{ Vector3::Dot(triangle.normal, ray.direction) };
+			const float dotRayNormal{ Vector3::Dot(normal, ray.direction) };
 			if (dotRayNormal == 0.f)
 			{
 				return false;
 			}
 
-			if (triangle.cullMode == TriangleCullMode::FrontFaceCulling)
+			if (cullMode == TriangleCullMode::FrontFaceCulling)
 			{
 				if (dotRayNormal < 0.f && !ignoreHitRecord)
 				{
@@ -102,7 +113,7 @@ namespace dae
 					return false;
 				}
 			}
-			else if (triangle.cullMode == TriangleCullMode::BackFaceCulling)
+			else if (cullMode == TriangleCullMode::BackFaceCulling)
 			{
 				if (dotRayNormal > 0.f && !ignoreHitRecord)
 				{
@@ -113,36 +124,241 @@ namespace dae
 					return false;
 				}
 			}
-			
-			const Vector3 center = (triangle.v0 + triangle.v1 + triangle.v2) / 3.f;
 
-			const Vector3 l = center - ray.origin;
-			const float t = Vector3::Dot(l, triangle.normal) / Vector3::Dot(ray.direction, triangle.normal);
-
-			if(t < ray.min || t > ray.max)
+			//Cross products are written out so the packet version can repeat the exact same operations
+			const Vector3 directionCrossEdge1{
+				ray.direction.y * edge1.z - ray.direction.z * edge1.y,
+				ray.direction.z * edge1.x - ray.direction.x * edge1.z,
+				ray.direction.x * edge1.y - ray.direction.y * edge1.x };
+			const float determinant{ Vector3::Dot(edge0, directionCrossEdge1) };
+			if (determinant == 0.f)
 			{
 				return false;
 			}
+			const float invDeterminant{ 1.f / determinant };
 
-			const Vector3 p = ray.origin + t * ray.direction;
+			//Barycentric coordinates of the hit, the hit is inside when u, v and u + v are all in [0, 1]
+			const Vector3 cornerToOrigin{ ray.origin - v0 };
+			u = Vector3::Dot(cornerToOrigin, directionCrossEdge1) * invDeterminant;
+			if (u < 0.f || u > 1.f)
+			{
+				return false;
+			}
 
-			const Vector3 edgeA = triangle.v1 - triangle.v0;
-			const Vector3 pointToSideV0 = p - triangle.v0;
-			if(Vector3::Dot(triangle.normal, Vector3::Cross(edgeA, pointToSideV0)) < 0)
+			const Vector3 originCrossEdge0{
+				cornerToOrigin.y * edge0.z - cornerToOrigin.z * edge0.y,
+				cornerToOrigin.z * edge0.x - cornerToOrigin.x * edge0.z,
+				cornerToOrigin.x * edge0.y - cornerToOrigin.y * edge0.x };
+			v = Vector3::Dot(ray.direction, originCrossEdge0) * invDeterminant;
+			if (v < 0.f || u + v > 1.f)
 			{
 				return false;
 			}
 
-			const Vector3 edgeB = triangle.v2 - triangle.v1;
-			const Vector3 pointToSideV1 = p - triangle.v1;
-			if (Vector3::Dot(triangle.normal, Vector3::Cross(edgeB, pointToSideV1)) < 0)
+			t = Vector3::Dot(edge1, originCrossEdge0) * invDeterminant;
+			if (t < ray.min || t > ray.max)
 			{
 				return false;
 			}
+			return true;
+		}
+
+		inline bool HitTest_Triangle(const Vector3& v0, const Vector3& edge0, const Vector3& edge1, const Vector3& normal, TriangleCullMode cullMode,
+			const Ray& ray, float& t, bool ignoreHitRecord = false)
+		{
+			float u{};
+			float v{};
+			return HitTest_Triangle(v0, edge0, edge1, normal, cullMode, ray, t, u, v, ignoreHitRecord);
+		}
+
+		inline bool HitTest_Triangle(const TriangleSoA& triangles, int slot, TriangleCullMode cullMode, const Ray& ray, float& t, float& u, float& v,
+			bool ignoreHitRecord = false)
+		{
+			return HitTest_Triangle(triangles.GetV0(slot), triangles.GetEdge0(slot), triangles.GetEdge1(slot), triangles.GetNormal(slot), cullMode, ray, t, u, v, ignoreHitRecord);
+		}
+
+		/**
+		 * \brief Intersects a ray with a padded run of triangles, same hit rules as the single triangle test
+		 * \param first first slot of the run, multiple of TriangleSoA::Width
+		 * \param count number of slots in the run, multiple of TriangleSoA::Width
+		 * \param t distance to the closest hit, only written when a triangle closer than tMax is hit
+		 * \param hitU, hitV barycentrics of the closest hit, written together with t
+		 * \param ignoreHitRecord shadow ray, stops at the first hit and culls the opposite side
+		 * \return slot of the closest hit, -1 if no triangle is hit
+		 */
+		inline int HitTest_Triangles(const TriangleSoA& triangles, int first, int count, TriangleCullMode cullMode, const Ray& ray, float tMax, float& t,
+			float& hitU, float& hitV, bool ignoreHitRecord = false)
+		{
+			int hitSlot{ -1 };
+			const int end{ first + count };
+
+			//Shadow rays keep the side the primary rays cull
+			const bool cullPositive{ (cullMode == TriangleCullMode::BackFaceCulling) != ignoreHitRecord };
+
+#if defined(__AVX2__)
+			//No fused multiply-add here, the results have to match the SSE packet test bit for bit
+			const __m256 rayOriginX{ _mm256_set1_ps(ray.origin.x) };
+			const __m256 rayOriginY{ _mm256_set1_ps(ray.origin.y) };
+			const __m256 rayOriginZ{ _mm256_set1_ps(ray.origin.z) };
+			const __m256 rayDirectionX{ _mm256_set1_ps(ray.direction.x) };
+			const __m256 rayDirectionY{ _mm256_set1_ps(ray.direction.y) };
+			const __m256 rayDirectionZ{ _mm256_set1_ps(ray.direction.z) };
+			const __m256 rayMin{ _mm256_set1_ps(ray.min) };
+			const __m256 zero{ _mm256_setzero_ps() };
+			const __m256 one{ _mm256_set1_ps(1.f) };
+
+			for (int slot{ first }; slot < end; slot += TriangleSoA::Width)
+			{
+				const __m256 edge0X{ _mm256_loadu_ps(&triangles.edge0X[slot]) };
+				const __m256 edge0Y{ _mm256_loadu_ps(&triangles.edge0Y[slot]) };
+				const __m256 edge0Z{ _mm256_loadu_ps(&triangles.edge0Z[slot]) };
+				const __m256 edge1X{ _mm256_loadu_ps(&triangles.edge1X[slot]) };
+				const __m256 edge1Y{ _mm256_loadu_ps(&triangles.edge1Y[slot]) };
+				const __m256 edge1Z{ _mm256_loadu_ps(&triangles.edge1Z[slot]) };
+
+				const __m256 dotRayNormal{ _mm256_add_ps(_mm256_add_ps(
+					_mm256_mul_ps(_mm256_loadu_ps(&triangles.normalX[slot]), rayDirectionX),
+					_mm256_mul_ps(_mm256_loadu_ps(&triangles.normalY[slot]), rayDirectionY)),
+					_mm256_mul_ps(_mm256_loadu_ps(&triangles.normalZ[slot]), rayDirectionZ)) };
+				__m256 mask{ _mm256_cmp_ps(dotRayNormal, zero, _CMP_NEQ_UQ) };
+				if (cullMode != TriangleCullMode::NoCulling)
+					mask = _mm256_and_ps(mask, cullPositive ? _mm256_cmp_ps(dotRayNormal, zero, _CMP_NGT_UQ) : _mm256_cmp_ps(dotRayNormal, zero, _CMP_NLT_UQ));
+
+				const __m256 crossX{ _mm256_sub_ps(_mm256_mul_ps(rayDirectionY, edge1Z), _mm256_mul_ps(rayDirectionZ, edge1Y)) };
+				const __m256 crossY{ _mm256_sub_ps(_mm256_mul_ps(rayDirectionZ, edge1X), _mm256_mul_ps(rayDirectionX, edge1Z)) };
+				const __m256 crossZ{ _mm256_sub_ps(_mm256_mul_ps(rayDirectionX, edge1Y), _mm256_mul_ps(rayDirectionY, edge1X)) };
+				const __m256 determinant{ _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(edge0X, crossX), _mm256_mul_ps(edge0Y, crossY)), _mm256_mul_ps(edge0Z, crossZ)) };
+				mask = _mm256_and_ps(mask, _mm256_cmp_ps(determinant, zero, _CMP_NEQ_UQ));
+				const __m256 invDeterminant{ _mm256_div_ps(one, determinant) };
+
+				const __m256 toOriginX{ _mm256_sub_ps(rayOriginX, _mm256_loadu_ps(&triangles.v0X[slot])) };
+				const __m256 toOriginY{ _mm256_sub_ps(rayOriginY, _mm256_loadu_ps(&triangles.v0Y[slot])) };
+				const __m256 toOriginZ{ _mm256_sub_ps(rayOriginZ, _mm256_loadu_ps(&triangles.v0Z[slot])) };
+				const __m256 u{ _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(toOriginX, crossX), _mm256_mul_ps(toOriginY, crossY)), _mm256_mul_ps(toOriginZ, crossZ)), invDeterminant) };
+				mask = _mm256_and_ps(mask, _mm256_and_ps(_mm256_cmp_ps(u, zero, _CMP_NLT_UQ), _mm256_cmp_ps(u, one, _CMP_NGT_UQ)));
+
+				const __m256 originCrossX{ _mm256_sub_ps(_mm256_mul_ps(toOriginY, edge0Z), _mm256_mul_ps(toOriginZ, edge0Y)) };
+				const __m256 originCrossY{ _mm256_sub_ps(_mm256_mul_ps(toOriginZ, edge0X), _mm256_mul_ps(toOriginX, edge0Z)) };
+				const __m256 originCrossZ{ _mm256_sub_ps(_mm256_mul_ps(toOriginX, edge0Y), _mm256_mul_ps(toOriginY, edge0X)) };
+				const __m256 v{ _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(rayDirectionX, originCrossX), _mm256_mul_ps(rayDirectionY, originCrossY)), _mm256_mul_ps(rayDirectionZ, originCrossZ)), invDeterminant) };
+				mask = _mm256_and_ps(mask, _mm256_and_ps(_mm256_cmp_ps(v, zero, _CMP_NLT_UQ), _mm256_cmp_ps(_mm256_add_ps(u, v), one, _CMP_NGT_UQ)));
+
+				const __m256 distance{ _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(edge1X, originCrossX), _mm256_mul_ps(edge1Y, originCrossY)), _mm256_mul_ps(edge1Z, originCrossZ)), invDeterminant) };
+				mask = _mm256_and_ps(mask, _mm256_cmp_ps(distance, rayMin, _CMP_NLT_UQ));
+				mask = _mm256_and_ps(mask, _mm256_cmp_ps(distance, _mm256_set1_ps(tMax), _CMP_NGT_UQ));
+
+				int laneMask{ _mm256_movemask_ps(mask) };
+				if (laneMask == 0)
+					continue;
+
+				alignas(32) float distances[TriangleSoA::Width];
+				alignas(32) float weightsU[TriangleSoA::Width];
+				alignas(32) float weightsV[TriangleSoA::Width];
+				_mm256_store_ps(distances, distance);
+				_mm256_store_ps(weightsU, u);
+				_mm256_store_ps(weightsV, v);
+#elif defined(_M_X64) || defined(__SSE2__)
+			const __m128 rayOriginX{ _mm_set1_ps(ray.origin.x) };
+			const __m128 rayOriginY{ _mm_set1_ps(ray.origin.y) };
+			const __m128 rayOriginZ{ _mm_set1_ps(ray.origin.z) };
+			const __m128 rayDirectionX{ _mm_set1_ps(ray.direction.x) };
+			const __m128 rayDirectionY{ _mm_set1_ps(ray.direction.y) };
+			const __m128 rayDirectionZ{ _mm_set1_ps(ray.direction.z) };
+			const __m128 rayMin{ _mm_set1_ps(ray.min) };
+			const __m128 zero{ _mm_setzero_ps() };
+			const __m128 one{ _mm_set1_ps(1.f) };
+
+			for (int slot{ first }; slot < end; slot += TriangleSoA::Width)
+			{
+				const __m128 edge0X{ _mm_loadu_ps(&triangles.edge0X[slot]) };
+				const __m128 edge0Y{ _mm_loadu_ps(&triangles.edge0Y[slot]) };
+				const __m128 edge0Z{ _mm_loadu_ps(&triangles.edge0Z[slot]) };
+				const __m128 edge1X{ _mm_loadu_ps(&triangles.edge1X[slot]) };
+				const __m128 edge1Y{ _mm_loadu_ps(&triangles.edge1Y[slot]) };
+				const __m128 edge1Z{ _mm_loadu_ps(&triangles.edge1Z[slot]) };
+
+				const __m128 dotRayNormal{ _mm_add_ps(_mm_add_ps(
+					_mm_mul_ps(_mm_loadu_ps(&triangles.normalX[slot]), rayDirectionX),
+					_mm_mul_ps(_mm_loadu_ps(&triangles.normalY[slot]), rayDirectionY)),
+					_mm_mul_ps(_mm_loadu_ps(&triangles.normalZ[slot]), rayDirectionZ)) };
+				__m128 mask{ _mm_cmpneq_ps(dotRayNormal, zero) };
+				if (cullMode != TriangleCullMode::NoCulling)
+					mask = _mm_and_ps(mask, cullPositive ? _mm_cmpngt_ps(dotRayNormal, zero) : _mm_cmpnlt_ps(dotRayNormal, zero));
+
+				const __m128 crossX{ _mm_sub_ps(_mm_mul_ps(rayDirectionY, edge1Z), _mm_mul_ps(rayDirectionZ, edge1Y)) };
+				const __m128 crossY{ _mm_sub_ps(_mm_mul_ps(rayDirectionZ, edge1X), _mm_mul_ps(rayDirectionX, edge1Z)) };
+				const __m128 crossZ{ _mm_sub_ps(_mm_mul_ps(rayDirectionX, edge1Y), _mm_mul_ps(rayDirectionY, edge1X)) };
+				const __m128 determinant{ _mm_add_ps(_mm_add_ps(_mm_mul_ps(edge0X, crossX), _mm_mul_ps(edge0Y, crossY)), _mm_mul_ps(edge0Z, crossZ)) };
+				mask = _mm_and_ps(mask, _mm_cmpneq_ps(determinant, zero));
+				const __m128 invDeterminant{ _mm_div_ps(one, determinant) };
+
+				const __m128 toOriginX{ _mm_sub_ps(rayOriginX, _mm_loadu_ps(&triangles.v0X[slot])) };
+				const __m128 toOriginY{ _mm_sub_ps(rayOriginY, _mm_loadu_ps(&triangles.v0Y[slot])) };
+				const __m128 toOriginZ{ _mm_sub_ps(rayOriginZ, _mm_loadu_ps(&triangles.v0Z[slot])) };
+				const __m128 u{ _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(toOriginX, crossX), _mm_mul_ps(toOriginY, crossY)), _mm_mul_ps(toOriginZ, crossZ)), invDeterminant) };
+				mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmpnlt_ps(u, zero), _mm_cmpngt_ps(u, one)));
+
+				const __m128 originCrossX{ _mm_sub_ps(_mm_mul_ps(toOriginY, edge0Z), _mm_mul_ps(toOriginZ, edge0Y)) };
+				const __m128 originCrossY{ _mm_sub_ps(_mm_mul_ps(toOriginZ, edge0X), _mm_mul_ps(toOriginX, edge0Z)) };
+				const __m128 originCrossZ{ _mm_sub_ps(_mm_mul_ps(toOriginX, edge0Y), _mm_mul_ps(toOriginY, edge0X)) };
+				const __m128 v{ _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(rayDirectionX, originCrossX), _mm_mul_ps(rayDirectionY, originCrossY)), _mm_mul_ps(rayDirectionZ, originCrossZ)), invDeterminant) };
+				mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmpnlt_ps(v, zero), _mm_cmpngt_ps(_mm_add_ps(u, v), one)));
+
+				const __m128 distance{ _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(edge1X, originCrossX), _mm_mul_ps(edge1Y, originCrossY)), _mm_mul_ps(edge1Z, originCrossZ)), invDeterminant) };
+				mask = _mm_and_ps(mask, _mm_cmpnlt_ps(distance, rayMin));
+				mask = _mm_and_ps(mask, _mm_cmpngt_ps(distance, _mm_set1_ps(tMax)));
+
+				int laneMask{ _mm_movemask_ps(mask) };
+				if (laneMask == 0)
+					continue;
+
+				alignas(16) float distances[TriangleSoA::Width];
+				alignas(16) float weightsU[TriangleSoA::Width];
+				alignas(16) float weightsV[TriangleSoA::Width];
+				_mm_store_ps(distances, distance);
+				_mm_store_ps(weightsU, u);
+				_mm_store_ps(weightsV, v);
+#else
+			(void)cullPositive;
+			for (int slot{ first }; slot < end; ++slot)
+			{
+				float distances[TriangleSoA::Width]{};
+				float weightsU[TriangleSoA::Width]{};
+				float weightsV[TriangleSoA::Width]{};
+				const Ray blockRay{ ray.origin, ray.direction, ray.min, tMax };
+				int laneMask{ HitTest_Triangle(triangles, slot, cullMode, blockRay, distances[0], weightsU[0], weightsV[0], ignoreHitRecord) ? 1 : 0 };
+				if (laneMask == 0)
+					continue;
+#endif
+				//Lanes in slot order, so ties resolve like testing the triangles one by one
+				while (laneMask != 0)
+				{
+					const int lane{ std::countr_zero(static_cast<uint32_t>(laneMask)) };
+					laneMask &= laneMask - 1;
+
+					if (distances[lane] <= tMax)
+					{
+						tMax = distances[lane];
+						t = distances[lane];
+						hitU = weightsU[lane];
+						hitV = weightsV[lane];
+						hitSlot = slot + lane;
+
+						if (ignoreHitRecord)
+							return hitSlot;
+					}
+				}
+			}
+
+			return hitSlot;
+		}
 
-			const Vector3 edgeC = triangle.v0 - triangle.v2;
-			const Vector3 pointToSideV2 = p - triangle.v2;
-			if (Vector3::Dot(triangle.normal, Vector3::Cross(edgeC, pointToSideV2)) < 0)
+		inline bool HitTest_Triangle(const Triangle& triangle, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
+		{
+			//todo W5
+			//assert(false && "No Implemented Yet!");
+			float t{};
+			if (!HitTest_Triangle(triangle.v0, triangle.v1 - triangle.v0, triangle.v2 - triangle.v0, triangle.normal, triangle.cullMode, ray, t, ignoreHitRecord))
 			{
 				return false;
 			}
@@ -151,7 +367,7 @@ namespace dae
 			hitRecord.normal = triangle.normal;
 			hitRecord.materialIndex = triangle.materialIndex;
 			hitRecord.t = t;
-			hitRecord.origin = p;
+			hitRecord.origin = ray.origin + t * ray.direction;
 			return true;
 		}
 
@@ -161,44 +377,473 @@ namespace dae
 			return HitTest_Triangle(triangle, ray, temp, true);
 		}
 #pragma endregion
+#pragma region Packet HitTests
+		//PACKET HIT-TESTS
+		//Same rules as the single ray tests, one SSE register tests a row of 4 rays against the primitive.
+		//Comparisons are the negated miss tests of the single ray versions so both paths agree on every edge case.
+		//Only rays that find a hit closer than their candidate (and packet.max) are written.
+		inline void HitTest_Sphere(const Sphere& sphere, int sphereIdx, RayPacket& packet, uint32_t activeMask, HitCandidate* hits)
+		{
+#if defined(_M_X64) || defined(__SSE2__)
+			const __m128 sphereX{ _mm_set1_ps(sphere.origin.x) };
+			const __m128 sphereY{ _mm_set1_ps(sphere.origin.y) };
+			const __m128 sphereZ{ _mm_set1_ps(sphere.origin.z) };
+			const __m128 radiusSquared{ _mm_set1_ps(sphere.radius * sphere.radius) };
+			const __m128 rayMin{ _mm_set1_ps(packet.min) };
+
+			for (int row{}; row < RayPacket::Size; row += RayPacket::Width)
+			{
+				const uint32_t rowActive{ (activeMask >> row) & 0xF };
+				if (rowActive == 0)
+					continue;
+
+				const __m128 toSphereX{ _mm_sub_ps(sphereX, _mm_load_ps(&packet.originX[row])) };
+				const __m128 toSphereY{ _mm_sub_ps(sphereY, _mm_load_ps(&packet.originY[row])) };
+				const __m128 toSphereZ{ _mm_sub_ps(sphereZ, _mm_load_ps(&packet.originZ[row])) };
+
+				const __m128 hypothenuseSquared{ _mm_add_ps(_mm_add_ps(_mm_mul_ps(toSphereX, toSphereX), _mm_mul_ps(toSphereY, toSphereY)), _mm_mul_ps(toSphereZ, toSphereZ)) };
+				const __m128 side{ _mm_add_ps(_mm_add_ps(_mm_mul_ps(toSphereX, _mm_load_ps(&packet.directionX[row])),
+					_mm_mul_ps(toSphereY, _mm_load_ps(&packet.directionY[row]))), _mm_mul_ps(toSphereZ, _mm_load_ps(&packet.directionZ[row]))) };
+				const __m128 distanceToRaySquared{ _mm_sub_ps(hypothenuseSquared, _mm_mul_ps(side, side)) };
+				const __m128 distance{ _mm_sub_ps(side, _mm_sqrt_ps(_mm_max_ps(_mm_sub_ps(radiusSquared, distanceToRaySquared), _mm_setzero_ps()))) };
+
+				__m128 mask{ _mm_cmpnge_ps(distanceToRaySquared, radiusSquared) };
+				mask = _mm_and_ps(mask, _mm_cmpnlt_ps(distance, rayMin));
+				mask = _mm_and_ps(mask, _mm_cmpngt_ps(distance, _mm_load_ps(&packet.max[row])));
+
+				uint32_t rowHit{ static_cast<uint32_t>(_mm_movemask_ps(mask)) & rowActive };
+				if (rowHit == 0)
+					continue;
+
+				alignas(16) float distances[RayPacket::Width];
+				_mm_store_ps(distances, distance);
+				for (; rowHit != 0; rowHit &= rowHit - 1)
+				{
+					const int lane{ row + std::countr_zero(rowHit) };
+					const float t{ distances[lane - row] };
+					if (t >= hits[lane].t)
+						continue;
+
+					hits[lane] = { t, PrimitiveType::Sphere, sphereIdx };
+					packet.max[lane] = t;
+				}
+			}
+#else
+			HitRecord tempHitRecord{};
+			for (uint32_t lanes{ activeMask }; lanes != 0; lanes &= lanes - 1)
+			{
+				const int lane{ std::countr_zero(lanes) };
+				if (HitTest_Sphere(sphere, Ray{ packet.GetOrigin(lane), packet.GetDirection(lane), packet.min, packet.max[lane] }, tempHitRecord)
+					&& tempHitRecord.t < hits[lane].t)
+				{
+					hits[lane] = { tempHitRecord.t, PrimitiveType::Sphere, sphereIdx };
+					packet.max[lane] = tempHitRecord.t;
+				}
+			}
+#endif
+		}
+
+		inline void HitTest_Plane(const Plane& plane, int planeIdx, RayPacket& packet, uint32_t activeMask, HitCandidate* hits)
+		{
+#if defined(_M_X64) || defined(__SSE2__)
+			const __m128 planeX{ _mm_set1_ps(plane.origin.x) };
+			const __m128 planeY{ _mm_set1_ps(plane.origin.y) };
+			const __m128 planeZ{ _mm_set1_ps(plane.origin.z) };
+			const __m128 normalX{ _mm_set1_ps(plane.normal.x) };
+			const __m128 normalY{ _mm_set1_ps(plane.normal.y) };
+			const __m128 normalZ{ _mm_set1_ps(plane.normal.z) };
+			const __m128 rayMin{ _mm_set1_ps(packet.min) };
+
+			for (int row{}; row < RayPacket::Size; row += RayPacket::Width)
+			{
+				const uint32_t rowActive{ (activeMask >> row) & 0xF };
+				if (rowActive == 0)
+					continue;
+
+				const __m128 toPlaneX{ _mm_sub_ps(planeX, _mm_load_ps(&packet.originX[row])) };
+				const __m128 toPlaneY{ _mm_sub_ps(planeY, _mm_load_ps(&packet.originY[row])) };
+				const __m128 toPlaneZ{ _mm_sub_ps(planeZ, _mm_load_ps(&packet.originZ[row])) };
+
+				const __m128 numerator{ _mm_add_ps(_mm_add_ps(_mm_mul_ps(toPlaneX, normalX), _mm_mul_ps(toPlaneY, normalY)), _mm_mul_ps(toPlaneZ, normalZ)) };
+				const __m128 denominator{ _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_load_ps(&packet.directionX[row]), normalX),
+					_mm_mul_ps(_mm_load_ps(&packet.directionY[row]), normalY)), _mm_mul_ps(_mm_load_ps(&packet.directionZ[row]), normalZ)) };
+				const __m128 distance{ _mm_div_ps(numerator, denominator) };
+
+				__m128 mask{ _mm_cmpnlt_ps(distance, rayMin) };
+				mask = _mm_and_ps(mask, _mm_cmpngt_ps(distance, _mm_load_ps(&packet.max[row])));
+
+				uint32_t rowHit{ static_cast<uint32_t>(_mm_movemask_ps(mask)) & rowActive };
+				if (rowHit == 0)
+					continue;
+
+				alignas(16) float distances[RayPacket::Width];
+				_mm_store_ps(distances, distance);
+				for (; rowHit != 0; rowHit &= rowHit - 1)
+				{
+					const int lane{ row + std::countr_zero(rowHit) };
+					const float t{ distances[lane - row] };
+					if (t >= hits[lane].t)
+						continue;
+
+					hits[lane] = { t, PrimitiveType::Plane, planeIdx };
+					packet.max[lane] = t;
+				}
+			}
+#else
+			for (uint32_t lanes{ activeMask }; lanes != 0; lanes &= lanes - 1)
+			{
+				const int lane{ std::countr_zero(lanes) };
+				float t{};
+				if (HitTest_Plane(plane, Ray{ packet.GetOrigin(lane), packet.GetDirection(lane), packet.min, packet.max[lane] }, t) && t < hits[lane].t)
+				{
+					hits[lane] = { t, PrimitiveType::Plane, planeIdx };
+					packet.max[lane] = t;
+				}
+			}
+#endif
+		}
+
+		//primitiveType, primitiveIdx and triangleIdx identify the triangle in the candidates it wins
+		inline void HitTest_Triangle(const Vector3& v0, const Vector3& edge0, const Vector3& edge1, const Vector3& normal, TriangleCullMode cullMode,
+			PrimitiveType primitiveType, int primitiveIdx, int triangleIdx, RayPacket& packet, uint32_t activeMask, HitCandidate* hits)
+		{
+#if defined(_M_X64) || defined(__SSE2__)
+			const __m128 v0X{ _mm_set1_ps(v0.x) };
+			const __m128 v0Y{ _mm_set1_ps(v0.y) };
+			const __m128 v0Z{ _mm_set1_ps(v0.z) };
+			const __m128 edge0X{ _mm_set1_ps(edge0.x) };
+			const __m128 edge0Y{ _mm_set1_ps(edge0.y) };
+			const __m128 edge0Z{ _mm_set1_ps(edge0.z) };
+			const __m128 edge1X{ _mm_set1_ps(edge1.x) };
+			const __m128 edge1Y{ _mm_set1_ps(edge1.y) };
+			const __m128 edge1Z{ _mm_set1_ps(edge1.z) };
+			const __m128 normalX{ _mm_set1_ps(normal.x) };
+			const __m128 normalY{ _mm_set1_ps(normal.y) };
+			const __m128 normalZ{ _mm_set1_ps(normal.z) };
+			const __m128 zero{ _mm_setzero_ps() };
+			const __m128 one{ _mm_set1_ps(1.f) };
+			const __m128 rayMin{ _mm_set1_ps(packet.min) };
+
+			for (int row{}; row < RayPacket::Size; row += RayPacket::Width)
+			{
+				const uint32_t rowActive{ (activeMask >> row) & 0xF };
+				if (rowActive == 0)
+					continue;
+
+				const __m128 originX{ _mm_load_ps(&packet.originX[row]) };
+				const __m128 originY{ _mm_load_ps(&packet.originY[row]) };
+				const __m128 originZ{ _mm_load_ps(&packet.originZ[row]) };
+				const __m128 directionX{ _mm_load_ps(&packet.directionX[row]) };
+				const __m128 directionY{ _mm_load_ps(&packet.directionY[row]) };
+				const __m128 directionZ{ _mm_load_ps(&packet.directionZ[row]) };
+
+				const __m128 dotRayNormal{ _mm_add_ps(_mm_add_ps(_mm_mul_ps(normalX, directionX), _mm_mul_ps(normalY, directionY)), _mm_mul_ps(normalZ, directionZ)) };
+				__m128 mask{ _mm_cmpneq_ps(dotRayNormal, zero) };
+				if (cullMode == TriangleCullMode::FrontFaceCulling)
+					mask = _mm_and_ps(mask, _mm_cmpnlt_ps(dotRayNormal, zero));
+				else if (cullMode == TriangleCullMode::BackFaceCulling)
+					mask = _mm_and_ps(mask, _mm_cmpngt_ps(dotRayNormal, zero));
+
+				const __m128 crossX{ _mm_sub_ps(_mm_mul_ps(directionY, edge1Z), _mm_mul_ps(directionZ, edge1Y)) };
+				const __m128 crossY{ _mm_sub_ps(_mm_mul_ps(directionZ, edge1X), _mm_mul_ps(directionX, edge1Z)) };
+				const __m128 crossZ{ _mm_sub_ps(_mm_mul_ps(directionX, edge1Y), _mm_mul_ps(directionY, edge1X)) };
+				const __m128 determinant{ _mm_add_ps(_mm_add_ps(_mm_mul_ps(edge0X, crossX), _mm_mul_ps(edge0Y, crossY)), _mm_mul_ps(edge0Z, crossZ)) };
+				mask = _mm_and_ps(mask, _mm_cmpneq_ps(determinant, zero));
+				const __m128 invDeterminant{ _mm_div_ps(one, determinant) };
+
+				const __m128 toOriginX{ _mm_sub_ps(originX, v0X) };
+				const __m128 toOriginY{ _mm_sub_ps(originY, v0Y) };
+				const __m128 toOriginZ{ _mm_sub_ps(originZ, v0Z) };
+				const __m128 u{ _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(toOriginX, crossX), _mm_mul_ps(toOriginY, crossY)), _mm_mul_ps(toOriginZ, crossZ)), invDeterminant) };
+				mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmpnlt_ps(u, zero), _mm_cmpngt_ps(u, one)));
+				if ((_mm_movemask_ps(mask) & rowActive) == 0)
+					continue;
+
+				const __m128 originCrossX{ _mm_sub_ps(_mm_mul_ps(toOriginY, edge0Z), _mm_mul_ps(toOriginZ, edge0Y)) };
+				const __m128 originCrossY{ _mm_sub_ps(_mm_mul_ps(toOriginZ, edge0X), _mm_mul_ps(toOriginX, edge0Z)) };
+				const __m128 originCrossZ{ _mm_sub_ps(_mm_mul_ps(toOriginX, edge0Y), _mm_mul_ps(toOriginY, edge0X)) };
+				const __m128 v{ _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(directionX, originCrossX), _mm_mul_ps(directionY, originCrossY)), _mm_mul_ps(directionZ, originCrossZ)), invDeterminant) };
+				mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmpnlt_ps(v, zero), _mm_cmpngt_ps(_mm_add_ps(u, v), one)));
+
+				const __m128 distance{ _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(edge1X, originCrossX), _mm_mul_ps(edge1Y, originCrossY)), _mm_mul_ps(edge1Z, originCrossZ)), invDeterminant) };
+				mask = _mm_and_ps(mask, _mm_cmpnlt_ps(distance, rayMin));
+				mask = _mm_and_ps(mask, _mm_cmpngt_ps(distance, _mm_load_ps(&packet.max[row])));
+
+				uint32_t rowHit{ static_cast<uint32_t>(_mm_movemask_ps(mask)) & rowActive };
+				if (rowHit == 0)
+					continue;
+
+				alignas(16) float distances[RayPacket::Width];
+				alignas(16) float weightsU[RayPacket::Width];
+				alignas(16) float weightsV[RayPacket::Width];
+				_mm_store_ps(distances, distance);
+				_mm_store_ps(weightsU, u);
+				_mm_store_ps(weightsV, v);
+				for (; rowHit != 0; rowHit &= rowHit - 1)
+				{
+					const int rowLane{ std::countr_zero(rowHit) };
+					const int lane{ row + rowLane };
+					if (distances[rowLane] >= hits[lane].t)
+						continue;
+
+					hits[lane] = { distances[rowLane], primitiveType, primitiveIdx, triangleIdx, weightsU[rowLane], weightsV[rowLane] };
+					packet.max[lane] = distances[rowLane];
+				}
+			}
+#else
+			for (uint32_t lanes{ activeMask }; lanes != 0; lanes &= lanes - 1)
+			{
+				const int lane{ std::countr_zero(lanes) };
+				const Ray ray{ packet.GetOrigin(lane), packet.GetDirection(lane), packet.min, packet.max[lane] };
+
+				float t{};
+				float u{};
+				float v{};
+				if (HitTest_Triangle(v0, edge0, edge1, normal, cullMode, ray, t, u, v) && t < hits[lane].t)
+				{
+					hits[lane] = { t, primitiveType, primitiveIdx, triangleIdx, u, v };
+					packet.max[lane] = t;
+				}
+			}
+#endif
+		}
+
+		inline void HitTest_Triangle(const Triangle& triangle, int triangleIdx, RayPacket& packet, uint32_t activeMask, HitCandidate* hits)
+		{
+			HitTest_Triangle(triangle.v0, triangle.v1 - triangle.v0, triangle.v2 - triangle.v0, triangle.normal, triangle.cullMode,
+				PrimitiveType::Triangle, triangleIdx, -1, packet, activeMask, hits);
+		}
+#pragma endregion
 #pragma region TriangeMesh HitTest
-		inline bool HitTest_TriangleMesh(const TriangleMesh& mesh, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
+		/**
+		 * \brief Closest triangle of the mesh within the ray interval
+		 * \param hit only t, triangleIdx and the barycentrics are written, and only when a triangle is hit
+		 */
+		inline bool HitTest_TriangleMesh(const TriangleMesh& mesh, const Ray& ray, HitCandidate& hit)
 		{
 			//todo W5
 			//assert(false && "No Implemented Yet!");
-			float distance{ FLT_MAX };
-			HitRecord tempHitRecord{};
+			const TriangleSoA& triangles{ mesh.triangles };
+			const std::vector<BVHNode>& nodes{ mesh.bvh.GetNodes() };
+
+			//The max of the local ray shrinks with every closer hit, so farther nodes and triangles get skipped
+			Ray localRay{ ray };
+			int hitSlot{ -1 };
+			float u{};
+			float v{};
 
-			for (int triangleNr{}; triangleNr < int(mesh.indices.size() / 3); ++triangleNr) //3 indices indicate 1 triangle
+			mesh.bvh.Traverse(ray.origin, ray.direction, ray.min, localRay.max, [&](const BVHNode& leaf, float&)
+				{
+					//All triangles of the leaf in one SIMD run
+					const TriangleSoA::LeafRun& run{ triangles.leafRuns[&leaf - nodes.data()] };
+
+					float t{};
+					const int slot{ HitTest_Triangles(triangles, run.first, run.count, mesh.cullMode, ray, localRay.max, t, u, v) };
+					if (slot >= 0)
+					{
+						localRay.max = t;
+						hitSlot = slot;
+					}
+					return false;
+				});
+
+			if (hitSlot == -1)
 			{
-				const Vector3 v0{ mesh.transformedPositions[mesh.indices[triangleNr * 3]] };
-				const Vector3 v1{ mesh.transformedPositions[mesh.indices[triangleNr * 3 + 1]] };
-				const Vector3 v2{ mesh.transformedPositions[mesh.indices[triangleNr * 3 + 2]] };
+				return false;
+			}
 
-				Triangle triangle{ v0,v1,v2, mesh.transformedNormals[triangleNr]};
+			hit.t = localRay.max;
+			hit.triangleIdx = triangles.triangleIndices[hitSlot];
+			hit.u = u;
+			hit.v = v;
+			return true;
+		}
 
-				triangle.cullMode = mesh.cullMode;
-				triangle.materialIndex = mesh.materialIndex;
-				if (HitTest_Triangle(triangle, ray, tempHitRecord, ignoreHitRecord))
+		/**
+		 * \brief Any hit, the traversal stops at the first triangle that blocks the ray
+		 * \param triangleIdx triangle number of the blocking triangle, only written when true is returned
+		 */
+		inline bool HitTest_TriangleMesh(const TriangleMesh& mesh, const Ray& ray, int& triangleIdx)
+		{
+			const TriangleSoA& triangles{ mesh.triangles };
+			const std::vector<BVHNode>& nodes{ mesh.bvh.GetNodes() };
+
+			float tMax{ ray.max };
+			return mesh.bvh.Traverse(ray.origin, ray.direction, ray.min, tMax, [&](const BVHNode& leaf, float&)
 				{
-					if (ignoreHitRecord)
+					const TriangleSoA::LeafRun& run{ triangles.leafRuns[&leaf - nodes.data()] };
+
+					float t{};
+					float u{};
+					float v{};
+					const int slot{ HitTest_Triangles(triangles, run.first, run.count, mesh.cullMode, ray, ray.max, t, u, v, true) };
+					if (slot < 0)
 					{
-						return true;
+						return false;
 					}
-					if(tempHitRecord.didHit && tempHitRecord.t < distance)
+
+					triangleIdx = triangles.triangleIndices[slot];
+					return true;
+				});
+		}
+
+		inline bool HitTest_TriangleMesh(const TriangleMesh& mesh, const Ray& ray)
+		{
+			int triangleIdx{};
+			return HitTest_TriangleMesh(mesh, ray, triangleIdx);
+		}
+
+		//Any hit against one triangle of the mesh, gives the same answer the triangle gets inside the BVH traversal
+		inline bool HitTest_MeshTriangle(const TriangleMesh& mesh, int triangleIdx, const Ray& ray)
+		{
+			const std::vector<Vector3>& positions{ mesh.transformedPositions };
+			const Vector3& v0{ positions[mesh.indices[triangleIdx * 3]] };
+			const Vector3 edge0{ positions[mesh.indices[triangleIdx * 3 + 1]] - v0 };
+			const Vector3 edge1{ positions[mesh.indices[triangleIdx * 3 + 2]] - v0 };
+
+			float t{};
+			return HitTest_Triangle(v0, edge0, edge1, mesh.transformedNormals[triangleIdx].Normalized(), mesh.cullMode, ray, t, true);
+		}
+
+		inline bool HitTest_TriangleMesh(const TriangleMesh& mesh, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
+		{
+			if (ignoreHitRecord)
+			{
+				hitRecord.didHit = HitTest_TriangleMesh(mesh, ray);
+				return hitRecord.didHit;
+			}
+
+			HitCandidate hit{};
+			if (!HitTest_TriangleMesh(mesh, ray, hit))
+			{
+				return false;
+			}
+
+			hitRecord.didHit = true;
+			hitRecord.normal = mesh.transformedNormals[hit.triangleIdx].Normalized();
+			hitRecord.materialIndex = mesh.materialIndex;
+			hitRecord.t = hit.t;
+			hitRecord.origin = ray.origin + hit.t * ray.direction;
+			return true;
+		}
+
+		//Tests every triangle one by one without the BVH, only meant as reference for validating the accelerated version
+		inline bool HitTest_TriangleMeshReference(const TriangleMesh& mesh, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
+		{
+			const std::vector<Vector3>& positions{ mesh.transformedPositions };
+
+			int hitTriangleNr{ -1 };
+			float tClosest{ ray.max };
+			for (int triangleNr{}; triangleNr < int(mesh.indices.size() / 3); ++triangleNr)
+			{
+				const Vector3& v0{ positions[mesh.indices[triangleNr * 3]] };
+				const Vector3 edge0{ positions[mesh.indices[triangleNr * 3 + 1]] - v0 };
+				const Vector3 edge1{ positions[mesh.indices[triangleNr * 3 + 2]] - v0 };
+				const Vector3 normal{ mesh.transformedNormals[triangleNr].Normalized() };
+
+				float t{};
+				if (!HitTest_Triangle(v0, edge0, edge1, normal, mesh.cullMode, ray, t, ignoreHitRecord) || (hitTriangleNr != -1 && t >= tClosest))
+				{
+					continue;
+				}
+
+				if (ignoreHitRecord)
+				{
+					hitRecord.didHit = true;
+					return true;
+				}
+
+				hitTriangleNr = triangleNr;
+				tClosest = t;
+			}
+
+			if (hitTriangleNr == -1)
+			{
+				hitRecord.didHit = false;
+				return false;
+			}
+
+			hitRecord.didHit = true;
+			hitRecord.normal = mesh.transformedNormals[hitTriangleNr].Normalized();
+			hitRecord.materialIndex = mesh.materialIndex;
+			hitRecord.t = tClosest;
+			hitRecord.origin = ray.origin + tClosest * ray.direction;
+			return true;
+		}
+
+		/**
+		 * \brief Closest hit for the active rays of a packet, sharing the BVH traversal and the triangle setup between them
+		 * \param meshIdx index of the mesh in the scene, stored in the candidates it wins
+		 * \param hits one candidate per lane, only overwritten by hits closer than the candidate (and packet.max)
+		 */
+		inline void HitTest_TriangleMesh(const TriangleMesh& mesh, int meshIdx, RayPacket& packet, uint32_t activeMask, HitCandidate* hits)
+		{
+			const TriangleSoA& triangles{ mesh.triangles };
+			const std::vector<BVHNode>& nodes{ mesh.bvh.GetNodes() };
+
+			mesh.bvh.TraversePacket(packet, activeMask, [&](const BVHNode& leaf, uint32_t laneMask)
+				{
+					const TriangleSoA::LeafRun& run{ triangles.leafRuns[&leaf - nodes.data()] };
+					for (int slot{ run.first }; slot < run.first + leaf.primitiveCount; ++slot)
 					{
-						distance = tempHitRecord.t;
-						hitRecord = tempHitRecord;
+						HitTest_Triangle(triangles.GetV0(slot), triangles.GetEdge0(slot), triangles.GetEdge1(slot), triangles.GetNormal(slot), mesh.cullMode,
+							PrimitiveType::TriangleMesh, meshIdx, triangles.triangleIndices[slot], packet, laneMask, hits);
 					}
-				}
+				});
+		}
+
+		//The object space direction is not normalized, so t and the barycentrics found in the space of the mesh are valid in world space as well
+		inline Ray GetObjectRay(const TriangleMeshInstance& instance, const Ray& ray)
+		{
+			return { instance.inverseTransform.TransformPoint(ray.origin), instance.inverseTransform.TransformVector(ray.direction), ray.min, ray.max };
+		}
+
+		/**
+		 * \brief Moves the ray into the space of the instanced mesh, tests it there and moves the hit back into world space
+		 * \param hitTestMesh called as hitTestMesh(objectRay, hitRecord, ignoreHitRecord)
+		 */
+		template<typename MeshHitTest>
+		bool HitTest_Instance(const TriangleMeshInstance& instance, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord, const MeshHitTest& hitTestMesh)
+		{
+			if (!hitTestMesh(GetObjectRay(instance, ray), hitRecord, ignoreHitRecord))
+			{
+				return false;
+			}
+
+			if (ignoreHitRecord)
+			{
+				return true;
 			}
-			return hitRecord.didHit;
+
+			hitRecord.origin = ray.origin + hitRecord.t * ray.direction;
+			hitRecord.normal = instance.normalTransform.TransformVector(hitRecord.normal).Normalized();
+			hitRecord.materialIndex = instance.materialIndex;
+			return true;
 		}
 
-		inline bool HitTest_TriangleMesh(const TriangleMesh& mesh, const Ray& ray)
+		inline bool HitTest_TriangleMeshInstance(const TriangleMesh& mesh, const TriangleMeshInstance& instance, const Ray& ray, HitCandidate& hit)
+		{
+			return HitTest_TriangleMesh(mesh, GetObjectRay(instance, ray), hit);
+		}
+
+		//Any hit, triangleIdx is the blocking triangle of the instanced mesh
+		inline bool HitTest_TriangleMeshInstance(const TriangleMesh& mesh, const TriangleMeshInstance& instance, const Ray& ray, int& triangleIdx)
+		{
+			return HitTest_TriangleMesh(mesh, GetObjectRay(instance, ray), triangleIdx);
+		}
+
+		inline bool HitTest_TriangleMeshInstance(const TriangleMesh& mesh, const TriangleMeshInstance& instance, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
+		{
+			return HitTest_Instance(instance, ray, hitRecord, ignoreHitRecord, [&mesh](const Ray& objectRay, HitRecord& objectHitRecord, bool ignoreObjectHitRecord)
+				{
+					return HitTest_TriangleMesh(mesh, objectRay, objectHitRecord, ignoreObjectHitRecord);
+				});
+		}
+
+		inline bool HitTest_TriangleMeshInstance(const TriangleMesh& mesh, const TriangleMeshInstance& instance, const Ray& ray)
 		{
 			HitRecord temp{};
-			return HitTest_TriangleMesh(mesh, ray, temp, true);
+			return HitTest_TriangleMeshInstance(mesh, instance, ray, temp, true);
 		}
 #pragma endregion
 	}
@@ -233,72 +878,33 @@ namespace dae
 
 	namespace Utils
 	{
-		//Just parses vertices and indices
+		//Parses positions and triangles and computes a face normal per triangle, see LoadOBJ for the supported syntax.
+		//Appends to the vectors, the new indices are offset so they point at the appended positions.
 #pragma warning(push)
 #pragma warning(disable : 4505) //Warning unreferenced local function
 		static bool ParseOBJ(const std::string& filename, std::vector<Vector3>& positions, std::vector<Vector3>& normals, std::vector<int>& indices)
 		{
-			std::ifstream file(filename);
-			if (!file)
+			ObjData data{};
+			if (!LoadOBJ(filename, data))
 				return false;
 
-			std::string sCommand;
-			// start a while iteration ending when the end of file is reached (ios::eof)
-			while (!file.eof())
+			const int firstVertex{ static_cast<int>(positions.size()) };
+			const size_t firstIndex{ indices.size() };
+			positions.insert(positions.end(), data.positions.begin(), data.positions.end());
+			indices.reserve(firstIndex + data.indices.size());
+			for (const int index : data.indices)
 			{
-				//read the first word of the string, use the >> operator (istream::operator>>) 
-				file >> sCommand;
-				//use conditional statements to process the different commands	
-				if (sCommand == "#")
-				{
-					// Ignore Comment
-				}
-				else if (sCommand == "v")
-				{
-					//Vertex
-					float x, y, z;
-					file >> x >> y >> z;
-					positions.push_back({ x, y, z });
-				}
-				else if (sCommand == "f")
-				{
-					float i0, i1, i2;
-					file >> i0 >> i1 >> i2;
-
-					indices.push_back((int)i0 - 1);
-					indices.push_back((int)i1 - 1);
-					indices.push_back((int)i2 - 1);
-				}
-				//read till end of line and ignore all remaining chars
-				file.ignore(1000, '\n');
-
-				if (file.eof()) 
-					break;
+				indices.push_back(firstVertex + index);
 			}
 
 			//Precompute normals
-			for (uint64_t index = 0; index < indices.size(); index += 3)
+			normals.reserve(normals.size() + data.indices.size() / 3);
+			for (size_t cornerIdx{ firstIndex }; cornerIdx < indices.size(); cornerIdx += 3)
 			{
-				uint32_t i0 = indices[index];
-				uint32_t i1 = indices[index + 1];
-				uint32_t i2 = indices[index + 2];
-
-				Vector3 edgeV0V1 = positions[i1] - positions[i0];
-				Vector3 edgeV0V2 = positions[i2] - positions[i0];
-				Vector3 normal = Vector3::Cross(edgeV0V1, edgeV0V2);
-
-				if(isnan(normal.x))
-				{
-					int k = 0;
-				}
-
-				normal.Normalize();
-				if (isnan(normal.x))
-				{
-					int k = 0;
-				}
-
-				normals.push_back(normal);
+				const Vector3& v0{ positions[indices[cornerIdx]] };
+				const Vector3 edgeV0V1{ positions[indices[cornerIdx + 1]] - v0 };
+				const Vector3 edgeV0V2{ positions[indices[cornerIdx + 2]] - v0 };
+				normals.push_back(Vector3::Cross(edgeV0V1, edgeV0V2).Normalized());
 			}
 
 			return true;
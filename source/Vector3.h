@@ -1,8 +1,19 @@
 #pragma once
+#include <cassert>
+#include <cmath>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
 namespace dae
 {
 	struct Vector4;
+	//Everything is defined inline in the headers, so the math in the intersection loops never pays for a call.
+	//Vector3 stays plain scalar code apart from the division by a scalar: it is 12 bytes and packing it into a register costs more
+	//than the three multiplies it would save. --math-benchmark times packed SSE versions next to the scalar ones, they run Dot at
+	//0.3x to 0.5x and Cross at 0.4x to 0.5x of the scalar speed (SSE2, SSE4.1 and AVX2 builds alike). Only the divide wins,
+	//one packed divide instead of three makes Normalized about 1.4x faster.
 	struct Vector3
 	{
 		float x{};
@@ -49,9 +60,151 @@ namespace dae
 		static const Vector3 Zero;
 	};
 
+	inline const Vector3 Vector3::UnitX = Vector3{ 1, 0, 0 };
+	inline const Vector3 Vector3::UnitY = Vector3{ 0, 1, 0 };
+	inline const Vector3 Vector3::UnitZ = Vector3{ 0, 0, 1 };
+	inline const Vector3 Vector3::Zero = Vector3{ 0, 0, 0 };
+
+	inline Vector3::Vector3(float _x, float _y, float _z) : x(_x), y(_y), z(_z){}
+
+	inline Vector3::Vector3(const Vector3& from, const Vector3& to) : x(to.x - from.x), y(to.y - from.y), z(to.z - from.z){}
+
+	inline float Vector3::Magnitude() const
+	{
+		return sqrtf(x * x + y * y + z * z);
+	}
+
+	inline float Vector3::SqrMagnitude() const
+	{
+		return x * x + y * y + z * z;
+	}
+
+	inline float Vector3::Normalize()
+	{
+		const float m = Magnitude();
+		*this = *this / m;
+
+		return m;
+	}
+
+	inline Vector3 Vector3::Normalized() const
+	{
+		return *this / Magnitude();
+	}
+
+	inline float Vector3::Dot(const Vector3& v1, const Vector3& v2)
+	{
+		return v1.x * v2.x + v1.y * v2.y + v1.z * v2.z;
+	}
+
+	inline Vector3 Vector3::Cross(const Vector3& v1, const Vector3& v2)
+	{
+		return { v1.y * v2.z - v1.z * v2.y, -(v1.x * v2.z - v1.z * v2.x), v1.x * v2.y - v1.y * v2.x };
+	}
+
+	inline Vector3 Vector3::Project(const Vector3& v1, const Vector3& v2)
+	{
+		return (v2 * (Dot(v1, v2) / Dot(v2, v2)));
+	}
+
+	inline Vector3 Vector3::Reject(const Vector3& v1, const Vector3& v2)
+	{
+		return (v1 - v2 * (Dot(v1, v2) / Dot(v2, v2)));
+	}
+
+#pragma region Operator Overloads
+	inline Vector3 Vector3::operator*(float scale) const
+	{
+		return { x * scale, y * scale, z * scale };
+	}
+
+	inline Vector3 Vector3::operator/(float scale) const
+	{
+#if defined(_M_X64) || defined(__SSE2__)
+		//Divides are slow enough that one packed divide beats three scalar ones, the quotients are the same
+		alignas(16) float components[4];
+		_mm_store_ps(components, _mm_div_ps(_mm_setr_ps(x, y, z, 0.f), _mm_set1_ps(scale)));
+		return { components[0], components[1], components[2] };
+#else
+		return { x / scale, y / scale, z / scale };
+#endif
+	}
+
+	inline Vector3 Vector3::operator+(const Vector3& v) const
+	{
+		return { x + v.x, y + v.y, z + v.z };
+	}
+
+	inline Vector3 Vector3::operator-(const Vector3& v) const
+	{
+		return { x - v.x, y - v.y, z - v.z };
+	}
+
+	inline Vector3 Vector3::operator-() const
+	{
+		return { -x ,-y,-z };
+	}
+
+	inline Vector3& Vector3::operator*=(float scale)
+	{
+		x *= scale;
+		y *= scale;
+		z *= scale;
+		return *this;
+	}
+
+	inline Vector3& Vector3::operator/=(float scale)
+	{
+		*this = *this / scale;
+		return *this;
+	}
+
+	inline Vector3& Vector3::operator-=(const Vector3& v)
+	{
+		x -= v.x;
+		y -= v.y;
+		z -= v.z;
+		return *this;
+	}
+
+	inline Vector3& Vector3::operator+=(const Vector3& v)
+	{
+		x += v.x;
+		y += v.y;
+		z += v.z;
+		return *this;
+	}
+
+	inline float& Vector3::operator[](int index)
+	{
+		assert(index <= 2 && index >= 0);
+
+		if (index == 0) return x;
+		if (index == 1) return y;
+		return z;
+	}
+
+	inline float Vector3::operator[](int index) const
+	{
+		assert(index <= 2 && index >= 0);
+
+		if (index == 0) return x;
+		if (index == 1) return y;
+		return z;
+	}
+#pragma endregion
+
 	//Global Operators
 	inline Vector3 operator*(float scale, const Vector3& v)
 	{
 		return { v.x * scale, v.y * scale, v.z * scale };
 	}
+
+	inline Vector3 Vector3::Reflect(const Vector3& v1, const Vector3& v2)
+	{
+		return v1 - (2.f * Vector3::Dot(v1, v2) * v2);
+	}
 }
+
+//The conversions to and from Vector4 are defined there
+#include "Vector4.h"
@@ -1,8 +1,18 @@
 #pragma once
+#include <cassert>
+#include <cmath>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "Vector3.h"
 
 namespace dae
 {
 	struct Vector3;
+	//Four floats fill exactly one SSE register, the component wise operators work on all of them at once.
+	//Dot keeps the scalar summation order, so results match the scalar fallback bit for bit.
 	struct Vector4
 	{
 		float x;
@@ -28,5 +38,126 @@ namespace dae
 		Vector4& operator+=(const Vector4& v);
 		float& operator[](int index);
 		float operator[](int index) const;
+
+#if defined(_M_X64) || defined(__SSE2__)
+		__m128 Load() const { return _mm_loadu_ps(&x); }
+		void Store(__m128 v) { _mm_storeu_ps(&x, v); }
+#endif
 	};
+
+	inline Vector4::Vector4(float _x, float _y, float _z, float _w) : x(_x), y(_y), z(_z), w(_w) {}
+	inline Vector4::Vector4(const Vector3& v, float _w) : x(v.x), y(v.y), z(v.z), w(_w) {}
+
+	inline float Vector4::Magnitude() const
+	{
+		return sqrtf(x * x + y * y + z * z + w * w);
+	}
+
+	inline float Vector4::SqrMagnitude() const
+	{
+		return x * x + y * y + z * z + w * w;
+	}
+
+	inline float Vector4::Normalize()
+	{
+		const float m = Magnitude();
+		x /= m;
+		y /= m;
+		z /= m;
+		w /= m;
+
+		return m;
+	}
+
+	inline Vector4 Vector4::Normalized() const
+	{
+		const float m = Magnitude();
+		return { x / m, y / m, z / m, w / m };
+	}
+
+	inline float Vector4::Dot(const Vector4& v1, const Vector4& v2)
+	{
+		return v1.x * v2.x + v1.y * v2.y + v1.z * v2.z + v1.w * v2.w;
+	}
+
+#pragma region Operator Overloads
+	inline Vector4 Vector4::operator*(float scale) const
+	{
+#if defined(_M_X64) || defined(__SSE2__)
+		Vector4 result;
+		result.Store(_mm_mul_ps(Load(), _mm_set1_ps(scale)));
+		return result;
+#else
+		return { x * scale, y * scale, z * scale, w * scale };
+#endif
+	}
+
+	inline Vector4 Vector4::operator+(const Vector4& v) const
+	{
+#if defined(_M_X64) || defined(__SSE2__)
+		Vector4 result;
+		result.Store(_mm_add_ps(Load(), v.Load()));
+		return result;
+#else
+		return { x + v.x, y + v.y, z + v.z, w + v.w };
+#endif
+	}
+
+	inline Vector4 Vector4::operator-(const Vector4& v) const
+	{
+#if defined(_M_X64) || defined(__SSE2__)
+		Vector4 result;
+		result.Store(_mm_sub_ps(Load(), v.Load()));
+		return result;
+#else
+		return { x - v.x, y - v.y, z - v.z, w - v.w };
+#endif
+	}
+
+	inline Vector4& Vector4::operator+=(const Vector4& v)
+	{
+#if defined(_M_X64) || defined(__SSE2__)
+		Store(_mm_add_ps(Load(), v.Load()));
+#else
+		x += v.x;
+		y += v.y;
+		z += v.z;
+		w += v.w;
+#endif
+		return *this;
+	}
+
+	inline float& Vector4::operator[](int index)
+	{
+		assert(index <= 3 && index >= 0);
+
+		if (index == 0)return x;
+		if (index == 1)return y;
+		if (index == 2)return z;
+		return w;
+	}
+
+	inline float Vector4::operator[](int index) const
+	{
+		assert(index <= 3 && index >= 0);
+
+		if (index == 0)return x;
+		if (index == 1)return y;
+		if (index == 2)return z;
+		return w;
+	}
+#pragma endregion
+
+	//Vector3 conversions, defined here because they need both types complete
+	inline Vector3::Vector3(const Vector4& v) : x(v.x), y(v.y), z(v.z){}
+
+	inline Vector4 Vector3::ToPoint4() const
+	{
+		return { x, y, z, 1 };
+	}
+
+	inline Vector4 Vector3::ToVector4() const
+	{
+		return { x, y, z, 0 };
+	}
 }
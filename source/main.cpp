@@ -5,12 +5,22 @@
 #undef main
 
 //Standard includes
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cstdlib>
 #include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
 
 //Project includes
 #include "Timer.h"
 #include "Renderer.h"
 #include "Scene.h"
+#include "Benchmark.h"
+#include "MathBenchmark.h"
+#include "HitValidation.h"
 
 using namespace dae;
 
@@ -20,45 +30,369 @@ void ShutDown(SDL_Window* pWindow)
 	SDL_Quit();
 }
 
+struct LaunchOptions
+{
+	std::string sceneName{ "W4_ReferenceScene" };
+	int width{ 640 };
+	int height{ 480 };
+	int frameCount{ 1 };
+	std::string outputPath{ "RayTracing_Buffer.bmp" };
+	bool isHeadless{ false };
+	bool compareWithReference{ false };
+	bool isProgressive{ false };
+	bool isAdaptiveSampling{ false };
+	int maxAdaptiveSamples{ 16 };
+	float contrastThreshold{ 0.1f };
+	bool isLightSampling{ false };
+	int lightSamplesPerPixel{ 4 };
+	bool isLightCulling{ false };
+	float lightCullThreshold{ 0.01f };
+
+	//Benchmark only overrides what was passed explicitly, everything else runs the full suite
+	bool isBenchmark{ false };
+	bool hasSceneName{ false };
+	bool hasResolution{ false };
+	bool hasFrameCount{ false };
+	bool hasOutputPath{ false };
+	std::vector<int> threadCounts{};
+
+	bool isMathBenchmark{ false };
+	bool isHitValidation{ false };
+};
+
+void PrintUsage()
+{
+	std::cout << "Usage: RayTracer [--headless] [--scene name] [--width pixels] [--height pixels] [--frames count] [--output file.bmp] [--verify] [--progressive]" << std::endl;
+	std::cout << "                 [--aa maxSamples] [--aa-threshold contrast] [--light-samples count] [--light-cull threshold]" << std::endl;
+	std::cout << "       RayTracer --benchmark [--scene name] [--width pixels] [--height pixels] [--threads 1,4,8] [--frames count] [--output results.json|results.csv]" << std::endl;
+	std::cout << "       RayTracer --math-benchmark" << std::endl;
+	std::cout << "       RayTracer --validate" << std::endl;
+	std::cout << "Scenes:";
+	for (const std::string& sceneName : GetSceneNames())
+	{
+		std::cout << " " << sceneName;
+	}
+	std::cout << std::endl;
+}
+
+bool ParseArguments(int argc, char* args[], LaunchOptions& options)
+{
+	for (int argIdx{ 1 }; argIdx < argc; ++argIdx)
+	{
+		const std::string argument{ args[argIdx] };
+		const bool hasValue{ argIdx + 1 < argc };
+
+		if (argument == "--headless")
+		{
+			options.isHeadless = true;
+		}
+		else if (argument == "--verify")
+		{
+			options.compareWithReference = true;
+		}
+		else if (argument == "--progressive")
+		{
+			options.isProgressive = true;
+		}
+		else if (argument == "--aa" && hasValue)
+		{
+			options.isAdaptiveSampling = true;
+			options.maxAdaptiveSamples = std::atoi(args[++argIdx]);
+		}
+		else if (argument == "--aa-threshold" && hasValue)
+		{
+			options.contrastThreshold = static_cast<float>(std::atof(args[++argIdx]));
+		}
+		else if (argument == "--light-samples" && hasValue)
+		{
+			options.isLightSampling = true;
+			options.lightSamplesPerPixel = std::atoi(args[++argIdx]);
+		}
+		else if (argument == "--light-cull" && hasValue)
+		{
+			options.isLightCulling = true;
+			options.lightCullThreshold = static_cast<float>(std::atof(args[++argIdx]));
+		}
+		else if (argument == "--benchmark")
+		{
+			options.isBenchmark = true;
+		}
+		else if (argument == "--math-benchmark")
+		{
+			options.isMathBenchmark = true;
+		}
+		else if (argument == "--validate")
+		{
+			options.isHitValidation = true;
+		}
+		else if (argument == "--scene" && hasValue)
+		{
+			options.sceneName = args[++argIdx];
+			options.hasSceneName = true;
+		}
+		else if (argument == "--width" && hasValue)
+		{
+			options.width = std::atoi(args[++argIdx]);
+			options.hasResolution = true;
+		}
+		else if (argument == "--height" && hasValue)
+		{
+			options.height = std::atoi(args[++argIdx]);
+			options.hasResolution = true;
+		}
+		else if (argument == "--frames" && hasValue)
+		{
+			options.frameCount = std::atoi(args[++argIdx]);
+			options.hasFrameCount = true;
+		}
+		else if (argument == "--output" && hasValue)
+		{
+			options.outputPath = args[++argIdx];
+			options.hasOutputPath = true;
+		}
+		else if (argument == "--threads" && hasValue)
+		{
+			//Comma separated list of thread counts
+			std::stringstream threadList{ args[++argIdx] };
+			std::string threadCount{};
+			while (std::getline(threadList, threadCount, ','))
+			{
+				options.threadCounts.push_back(std::atoi(threadCount.c_str()));
+				if (options.threadCounts.back() <= 0)
+				{
+					std::cout << "Thread counts have to be positive" << std::endl;
+					return false;
+				}
+			}
+		}
+		else
+		{
+			std::cout << "Unknown or incomplete argument: " << argument << std::endl;
+			return false;
+		}
+	}
+
+	if (options.maxAdaptiveSamples <= 0)
+	{
+		std::cout << "The anti-aliasing sample budget has to be positive" << std::endl;
+		return false;
+	}
+
+	if (options.lightSamplesPerPixel <= 0)
+	{
+		std::cout << "The number of light samples has to be positive" << std::endl;
+		return false;
+	}
+
+	if (options.width <= 0 || options.height <= 0 || options.frameCount <= 0)
+	{
+		std::cout << "Width, height and frame count have to be positive" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+void PrintSampleDistribution(const Renderer* pRenderer)
+{
+	const std::vector<uint64_t> distribution{ pRenderer->GetSampleDistribution() };
+
+	uint64_t pixelCount{};
+	uint64_t sampleCount{};
+	for (int samples{ 1 }; samples < static_cast<int>(distribution.size()); ++samples)
+	{
+		pixelCount += distribution[samples];
+		sampleCount += distribution[samples] * samples;
+	}
+	if (pixelCount == 0)
+		return;
+
+	std::cout << "Samples per pixel (average " << static_cast<double>(sampleCount) / pixelCount << "):";
+	for (int samples{ 1 }; samples < static_cast<int>(distribution.size()); ++samples)
+	{
+		if (distribution[samples] > 0)
+			std::cout << " " << samples << ": " << 100.0 * distribution[samples] / pixelCount << "%";
+	}
+	std::cout << std::endl;
+}
+
+void PrintLightCulling(const Renderer* pRenderer)
+{
+	const RayStatistics statistics{ pRenderer->GetRayStatistics() };
+	const uint64_t candidateCount{ statistics.shadowRays + statistics.culledShadowRays };
+	if (candidateCount == 0)
+		return;
+
+	std::cout << "Light culling skipped " << statistics.culledShadowRays << " of " << candidateCount << " shadow rays ("
+		<< 100.0 * statistics.culledShadowRays / candidateCount << "%)" << std::endl;
+}
+
+//Renders a fixed number of frames without a window, the scene is animated with a fixed time step
+//so the same arguments always produce the same image
+int RunHeadless(const LaunchOptions& options, Scene* pScene)
+{
+	SDL_Init(SDL_INIT_TIMER);
+
+	const auto pTimer = new Timer();
+	const auto pRenderer = new Renderer(options.width, options.height);
+	if (!pRenderer->HasBuffer())
+	{
+		std::cout << "Could not create a " << options.width << "x" << options.height << " surface: " << SDL_GetError() << std::endl;
+		delete pRenderer;
+		delete pTimer;
+
+		SDL_Quit();
+		return 1;
+	}
+	if (options.isProgressive)
+		pRenderer->ToggleProgressiveRendering();
+	pRenderer->SetAdaptiveSampling(options.isAdaptiveSampling, options.maxAdaptiveSamples, options.contrastThreshold);
+	pRenderer->SetLightSampling(options.isLightSampling, options.lightSamplesPerPixel);
+	pRenderer->SetLightCulling(options.isLightCulling, options.lightCullThreshold);
+
+	pTimer->SetFixedTimeStep(1.f / 30.f);
+	pTimer->Start();
+
+	double totalMilliseconds{};
+	double minMilliseconds{ DBL_MAX };
+	double maxMilliseconds{};
+	for (int frameIdx{}; frameIdx < options.frameCount; ++frameIdx)
+	{
+		pScene->Update(pTimer);
+
+		const auto startTime{ std::chrono::steady_clock::now() };
+		pRenderer->Render(pScene);
+		const double frameMilliseconds{ std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count() };
+
+		totalMilliseconds += frameMilliseconds;
+		minMilliseconds = std::min(minMilliseconds, frameMilliseconds);
+		maxMilliseconds = std::max(maxMilliseconds, frameMilliseconds);
+		std::cout << "Frame " << frameIdx << ": " << frameMilliseconds << " ms" << std::endl;
+
+		pTimer->Update();
+	}
+	pTimer->Stop();
+
+	std::cout << "Rendered " << options.frameCount << " frames of " << options.sceneName << " at " << options.width << "x" << options.height
+		<< ", average " << totalMilliseconds / options.frameCount << " ms (min " << minMilliseconds << ", max " << maxMilliseconds << ")" << std::endl;
+	if (options.isProgressive)
+		std::cout << "Final image averages " << pRenderer->GetSampleCount() << " samples per pixel" << std::endl;
+	else if (options.isAdaptiveSampling)
+		PrintSampleDistribution(pRenderer);
+	if (options.isLightCulling)
+		PrintLightCulling(pRenderer);
+
+	const bool didSave{ !pRenderer->SaveBufferToImage(options.outputPath.c_str()) };
+	if (didSave)
+		std::cout << "Image saved to " << options.outputPath << std::endl;
+	else
+		std::cout << "Something went wrong. Image not saved to " << options.outputPath << std::endl;
+
+	//Regression check of the last frame against the reference path, a skipped check is no failure
+	const bool matchesReference{ !options.compareWithReference || pRenderer->CompareWithReference(pScene) != ReferenceResult::Failed };
+
+	delete pRenderer;
+	delete pTimer;
+
+	SDL_Quit();
+	return didSave && matchesReference ? 0 : 1;
+}
+
+int RunBenchmark(const LaunchOptions& options)
+{
+	SDL_Init(SDL_INIT_TIMER);
+
+	BenchmarkSettings settings{};
+	if (options.hasSceneName)
+		settings.sceneNames.push_back(options.sceneName);
+	if (options.hasResolution)
+		settings.resolutions.push_back({ options.width, options.height });
+	if (options.hasFrameCount)
+		settings.frameCount = options.frameCount;
+	if (options.hasOutputPath)
+		settings.outputPath = options.outputPath;
+	settings.threadCounts = options.threadCounts;
+
+	Benchmark benchmark{ settings };
+	const bool didSucceed{ benchmark.Run() };
+
+	SDL_Quit();
+	return didSucceed ? 0 : 1;
+}
+
 int main(int argc, char* args[])
 {
-	//Unreferenced parameters
-	(void)argc;
-	(void)args;
+	LaunchOptions options{};
+	if (!ParseArguments(argc, args, options))
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	if (options.isBenchmark)
+		return RunBenchmark(options);
+
+	if (options.isMathBenchmark)
+		return RunMathBenchmark() ? 0 : 1;
+
+	if (options.isHitValidation)
+		return RunHitValidation() ? 0 : 1;
+
+	const auto pScene = CreateScene(options.sceneName);
+	if (!pScene)
+	{
+		std::cout << "Unknown scene: " << options.sceneName << std::endl;
+		PrintUsage();
+		return 1;
+	}
+	pScene->Initialize();
+
+	if (options.isHeadless)
+	{
+		const int result{ RunHeadless(options, pScene) };
+		delete pScene;
+		return result;
+	}
 
 	//Create window + surfaces
 	SDL_Init(SDL_INIT_VIDEO);
 
-	const uint32_t width = 640;
-	const uint32_t height = 480;
-
 	SDL_Window* pWindow = SDL_CreateWindow(
 		"RayTracer - Siebe Boeckx",
 		SDL_WINDOWPOS_UNDEFINED,
 		SDL_WINDOWPOS_UNDEFINED,
-		width, height, 0);
+		options.width, options.height, 0);
 
 	if (!pWindow)
+	{
+		delete pScene;
 		return 1;
+	}
 
 	//Initialize "framework"
 	const auto pTimer = new Timer();
 	const auto pRenderer = new Renderer(pWindow);
+	if (!pRenderer->HasBuffer())
+	{
+		std::cout << "Could not get the window surface: " << SDL_GetError() << std::endl;
+		delete pRenderer;
+		delete pTimer;
+		delete pScene;
+
+		ShutDown(pWindow);
+		return 1;
+	}
+	if (options.isProgressive)
+		pRenderer->ToggleProgressiveRendering();
+	pRenderer->SetAdaptiveSampling(options.isAdaptiveSampling, options.maxAdaptiveSamples, options.contrastThreshold);
+	pRenderer->SetLightSampling(options.isLightSampling, options.lightSamplesPerPixel);
+	pRenderer->SetLightCulling(options.isLightCulling, options.lightCullThreshold);
 
-	//const auto pScene = new Scene_W1();
-	//const auto pScene = new Scene_W2();
-	//const auto pScene = new Scene_W3();
-	//const auto pScene = new Scene_W3_TestScene();
-	//const auto pScene = new Scene_W4_TestScene();
-	const auto pScene = new Scene_W4_ReferenceScene();
-	//const auto pScene = new Scene_W4_BunnyScene();
-	pScene->Initialize();
-	 
 	//Start loop
 	pTimer->Start();
 	float printTimer = 0.f;
 	bool isLooping = true;
 	bool takeScreenshot = false;
+	bool compareWithReference = false;
 	while (isLooping)
 	{
 		//--------- Get input events ---------
@@ -81,6 +415,26 @@ int main(int argc, char* args[])
 				{
 					pRenderer->CycleLightingMode();
 				}
+				if (e.key.keysym.scancode == SDL_SCANCODE_F4)
+				{
+					compareWithReference = true;
+				}
+				if (e.key.keysym.scancode == SDL_SCANCODE_F5)
+				{
+					pRenderer->ToggleProgressiveRendering();
+				}
+				if (e.key.keysym.scancode == SDL_SCANCODE_F6)
+				{
+					pRenderer->ToggleAdaptiveSampling();
+				}
+				if (e.key.keysym.scancode == SDL_SCANCODE_F7)
+				{
+					pRenderer->ToggleLightSampling();
+				}
+				if (e.key.keysym.scancode == SDL_SCANCODE_F8)
+				{
+					pRenderer->ToggleLightCulling();
+				}
 				break;
 			}
 
@@ -100,17 +454,28 @@ int main(int argc, char* args[])
 		{
 			printTimer = 0.f;
 			std::cout << "dFPS: " << pTimer->GetdFPS() << std::endl;
+			if (pRenderer->IsAdaptiveSampling())
+				PrintSampleDistribution(pRenderer);
+			if (pRenderer->IsLightCulling())
+				PrintLightCulling(pRenderer);
 		}
 
 		//Save screenshot after full render
 		if (takeScreenshot)
 		{
-			if (!pRenderer->SaveBufferToImage())
+			if (!pRenderer->SaveBufferToImage(options.outputPath.c_str()))
 				std::cout << "Screenshot saved!" << std::endl;
 			else
 				std::cout << "Something went wrong. Screenshot not saved!" << std::endl;
 			takeScreenshot = false;
 		}
+
+		//Regression check of the rendered frame against the reference path
+		if (compareWithReference)
+		{
+			pRenderer->CompareWithReference(pScene);
+			compareWithReference = false;
+		}
 	}
 	pTimer->Stop();
 